@@ -5,6 +5,29 @@
 #include "pwospf_topology.h"
 #include "sr_rt.h"
 
+/* Interfaz por la que se llega al próximo salto del camino de item: la
+   del primer tramo, que sale del router */
+static struct sr_if* dijkstra_first_hop(struct sr_instance* sr, struct dijkstra_item* item,
+                                        struct in_addr* next_hop)
+{
+    struct sr_if* iface;
+
+    while (item->parent != NULL)
+    {
+        item = item->parent;
+    }
+    *next_hop = item->topology_entry->next_hop;
+
+    for (iface = sr->if_list; iface != NULL; iface = iface->next)
+    {
+        if ((iface->ip & iface->mask) == (item->topology_entry->next_hop.s_addr & item->topology_entry->net_mask.s_addr))
+        {
+            break;
+        }
+    }
+    return iface;
+}
+
 /*---------------------------------------------------------------------
  * Method: run_dijkstra
  *
@@ -114,27 +137,60 @@ void* run_dijkstra(void* arg)
 
             if (final_item != NULL)
             {
-                while (final_item->parent != NULL)
-                {
-                    final_item = final_item->parent; /*dijkstra_stack_pop(dijkstra_stack);*/
+                /* Se instala una ruta por cada próximo salto distinto entre los
+                   caminos de costo mínimo; la FIB las agrupa como ECMP */
+                struct in_addr next_hops[SR_FIB_ECMP_MAX];
+                unsigned int num_next_hops = 0, i;
+                uint8_t best_cost = final_item->cost;
+                uint8_t reached = (final_item->topology_entry->net_num.s_addr == topo_entry->net_num.s_addr);
 
-                }
-                struct sr_if* next_hop_int = dij_param->sr->if_list;
-                while (next_hop_int != NULL)
+                while (final_item != NULL)
                 {
-                    if ((next_hop_int->ip & next_hop_int->mask) == (final_item->topology_entry->next_hop.s_addr & final_item->topology_entry->net_mask.s_addr))
+                    struct in_addr next_hop;
+                    struct sr_if* next_hop_int = dijkstra_first_hop(dij_param->sr, final_item, &next_hop);
+
+                    for (i = 0; i < num_next_hops; i++)
+                    {
+                        if (next_hops[i].s_addr == next_hop.s_addr)
+                        {
+                            break;
+                        }
+                    }
+                    if (i == num_next_hops && next_hop_int != NULL)
+                    {
+                        next_hops[num_next_hops++] = next_hop;
+                        sr_add_rt_entry(dij_param->sr, topo_entry->net_num, next_hop, topo_entry->net_mask, next_hop_int->name, 110);
+                    }
+
+                    if (!reached || num_next_hops == SR_FIB_ECMP_MAX)
                     {
                         break;
                     }
-                    next_hop_int = next_hop_int->next;
-                }
 
-                sr_add_rt_entry(dij_param->sr, topo_entry->net_num, final_item->topology_entry->next_hop, topo_entry->net_mask, next_hop_int->name, 110);
+                    /* Los demás caminos de igual costo al destino, si los hay,
+                       son los próximos de ese costo en el heap ordenado */
+                    do
+                    {
+                        final_item = dijkstra_stack_pop(dijkstra_heap);
+                    } while (final_item != NULL && final_item->cost == best_cost &&
+                             final_item->topology_entry->net_num.s_addr != topo_entry->net_num.s_addr);
+
+                    if (final_item != NULL && final_item->cost != best_cost)
+                    {
+                        /* Más caro: vuelve al frente del heap, donde estaba */
+                        dijkstra_stack_push(dijkstra_heap, final_item);
+                        final_item = NULL;
+                    }
+                }
             }
         }
         topo_entry = topo_entry->next;
     }
     Debug("\n-> PWOSPF: Dijkstra algorithm completed\n\n");
+
+    /* Publico la tabla nueva de una sola vez, el reenvío sigue usando la anterior hasta acá */
+    sr_publish_fib(dij_param->sr);
+
     Debug("\n-> PWOSPF: Printing the forwarding table\n");
     sr_print_routing_table(dij_param->sr);
 
@@ -0,0 +1,410 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.c
+ *
+ * Descripción:
+ *
+ * Tabla de adyacencias con cabezales Ethernet armados, ver sr_adj.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <netinet/in.h>
+
+#include "sr_adj.h"
+#include "sr_if.h"
+#include "sr_rcu.h"
+
+static unsigned int sr_adj_bucket(struct sr_adj_table* table, uint32_t ip)
+{
+    return (ip * 2654435761U) >> (32 - table->bits);
+}
+
+/* Reescribe la MAC destino del cabezal; se llama con el lock tomado */
+static void sr_adj_set(struct sr_adj* adj, const uint8_t* mac, int valid)
+{
+    sr_ethernet_hdr_t* hdr = (sr_ethernet_hdr_t*)adj->l2;
+
+    __atomic_store_n(&adj->seq, adj->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (mac != NULL)
+    {
+        memcpy(hdr->ether_dhost, mac, ETHER_ADDR_LEN);
+    }
+    adj->valid = valid;
+    __atomic_store_n(&adj->seq, adj->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Saca la adyacencia de su bucket y la deja esperando el período de
+   gracia. Los lectores que ya la tienen pueden seguir recorriendo la
+   cadena desde ella; se llama con el lock tomado. */
+static void sr_adj_retire(struct sr_adj_table* table, struct sr_adj* adj)
+{
+    struct sr_adj** pp = &table->buckets[sr_adj_bucket(table, adj->ip)];
+
+    while (*pp != adj)
+    {
+        pp = &(*pp)->next;
+    }
+    __atomic_store_n(pp, adj->next, __ATOMIC_RELEASE);
+    __atomic_store_n(&adj->linked, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&adj->gen, adj->gen + 1, __ATOMIC_RELEASE);
+    adj->free_next = table->retired;
+    table->retired = adj;
+    table->count--;
+}
+
+/* Busca la adyacencia en su bucket; se llama con el lock tomado */
+static struct sr_adj* sr_adj_find(struct sr_adj_table* table, uint32_t ip, unsigned int ifindex)
+{
+    struct sr_adj* adj;
+
+    for (adj = table->buckets[sr_adj_bucket(table, ip)]; adj != NULL; adj = adj->next)
+    {
+        if (adj->ip == ip && adj->ifindex == ifindex)
+        {
+            break;
+        }
+    }
+    return adj;
+}
+
+/* Toma una adyacencia libre y la enlaza sin resolver. Sin lugar retira
+   hasta SR_ADJ_SCAN sin resolver y sin rutas, que vuelven a estar libres
+   después del próximo sr_adj_reclaim, y devuelve NULL. Se llama con el
+   lock tomado. */
+static struct sr_adj* sr_adj_create(struct sr_adj_table* table, uint32_t ip, struct sr_if* iface)
+{
+    struct sr_adj** head = &table->buckets[sr_adj_bucket(table, ip)];
+    struct sr_adj* adj;
+    sr_ethernet_hdr_t* hdr;
+    unsigned int i;
+
+    if (table->free != NULL)
+    {
+        adj = table->free;
+        table->free = adj->free_next;
+    }
+    else if (table->used < table->size)
+    {
+        adj = &table->pool[table->used++];
+    }
+    else
+    {
+        for (i = 0; i < SR_ADJ_SCAN; i++)
+        {
+            adj = &table->pool[table->hand];
+            table->hand = (table->hand + 1) % table->size;
+            if (adj->linked && !adj->valid && adj->refs == 0)
+            {
+                sr_adj_retire(table, adj);
+            }
+        }
+        table->full++;
+        return NULL;
+    }
+
+    /* Ningún lector la alcanza hasta enlazarla: la cadena ya no la tiene
+       y las cachés de destinos la descartan por la generación */
+    adj->ip = ip;
+    adj->ifindex = iface->ifindex;
+    adj->valid = 0;
+    adj->refs = 0;
+    hdr = (sr_ethernet_hdr_t*)adj->l2;
+    memset(hdr->ether_dhost, 0, ETHER_ADDR_LEN);
+    memcpy(hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    hdr->ether_type = htons(ethertype_ip);
+    adj->linked = 1;
+    adj->next = *head;
+    __atomic_store_n(head, adj, __ATOMIC_RELEASE);
+    table->count++;
+    return adj;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_init
+ *
+ * Inicializa una tabla vacía con lugar para size adyacencias
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_init(struct sr_adj_table* table, unsigned int size)
+{
+    /* -- REQUIRES -- */
+    assert(table);
+    assert(size > 0);
+
+    table->bits = 1;
+    while ((1U << table->bits) < size)
+    {
+        table->bits++;
+    }
+    table->buckets = (struct sr_adj**)calloc(1U << table->bits, sizeof(struct sr_adj*));
+    table->pool = (struct sr_adj*)calloc(size, sizeof(struct sr_adj));
+    assert(table->buckets && table->pool);
+    table->size = size;
+    table->used = 0;
+    table->count = 0;
+    table->hand = 0;
+    table->free = NULL;
+    table->retired = NULL;
+    table->recycled = 0;
+    table->full = 0;
+    pthread_mutex_init(&(table->lock), NULL);
+} /* -- sr_adj_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_get
+ *
+ * Devuelve la adyacencia del vecino ip por la interfaz iface, creándola
+ * sin resolver si no existe. Devuelve NULL si la tabla está llena. Se
+ * llama dentro de una sección de lectura RCU, que protege el puntero
+ * devuelto hasta que termina.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_adj* sr_adj_get(struct sr_adj_table* table, uint32_t ip, struct sr_if* iface)
+{
+    struct sr_adj* adj;
+
+    /* -- REQUIRES -- */
+    assert(iface);
+
+    for (adj = __atomic_load_n(&table->buckets[sr_adj_bucket(table, ip)], __ATOMIC_ACQUIRE);
+         adj != NULL; adj = __atomic_load_n(&adj->next, __ATOMIC_ACQUIRE))
+    {
+        if (adj->ip == ip && adj->ifindex == iface->ifindex &&
+            __atomic_load_n(&adj->linked, __ATOMIC_RELAXED))
+        {
+            return adj;
+        }
+    }
+
+    pthread_mutex_lock(&(table->lock));
+
+    /* Otro escritor pudo haberla creado mientras tanto */
+    adj = sr_adj_find(table, ip, iface->ifindex);
+    if (adj == NULL)
+    {
+        adj = sr_adj_create(table, ip, iface);
+    }
+
+    pthread_mutex_unlock(&(table->lock));
+    return adj;
+} /* -- sr_adj_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_hold
+ *
+ * Como sr_adj_get, pero la adyacencia queda en la tabla hasta el
+ * sr_adj_release correspondiente. La usa cada ruta con gateway de una
+ * versión de la FIB.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_adj* sr_adj_hold(struct sr_adj_table* table, uint32_t ip, struct sr_if* iface)
+{
+    struct sr_adj* adj;
+
+    /* -- REQUIRES -- */
+    assert(iface);
+
+    pthread_mutex_lock(&(table->lock));
+    adj = sr_adj_find(table, ip, iface->ifindex);
+    if (adj == NULL)
+    {
+        adj = sr_adj_create(table, ip, iface);
+    }
+    if (adj != NULL)
+    {
+        adj->refs++;
+    }
+    pthread_mutex_unlock(&(table->lock));
+    return adj;
+} /* -- sr_adj_hold -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_release
+ *
+ * Devuelve una referencia de sr_adj_hold. Sin rutas y sin resolver, la
+ * adyacencia deja la tabla; resuelta, sigue hasta que vence su ARP.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_release(struct sr_adj_table* table, struct sr_adj* adj)
+{
+    /* -- REQUIRES -- */
+    assert(adj);
+    assert(adj->refs > 0);
+
+    pthread_mutex_lock(&(table->lock));
+    adj->refs--;
+    if (adj->refs == 0 && !adj->valid)
+    {
+        sr_adj_retire(table, adj);
+    }
+    pthread_mutex_unlock(&(table->lock));
+} /* -- sr_adj_release -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_resolve
+ *
+ * Completa la MAC destino de la adyacencia del vecino ip por la
+ * interfaz ifindex, la única por la que vale lo aprendido
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_resolve(struct sr_adj_table* table, uint32_t ip, unsigned int ifindex,
+                    const uint8_t* mac)
+{
+    struct sr_adj* adj;
+
+    pthread_mutex_lock(&(table->lock));
+    adj = sr_adj_find(table, ip, ifindex);
+    if (adj != NULL)
+    {
+        sr_adj_set(adj, mac, 1);
+    }
+    pthread_mutex_unlock(&(table->lock));
+} /* -- sr_adj_resolve -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_invalidate
+ *
+ * Marca sin resolver las adyacencias del vecino ip, por ejemplo al
+ * vencer o desalojarse su entrada ARP. Las que ninguna ruta usa dejan
+ * la tabla.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_invalidate(struct sr_adj_table* table, uint32_t ip)
+{
+    struct sr_adj* adj;
+    struct sr_adj* next;
+
+    pthread_mutex_lock(&(table->lock));
+    for (adj = table->buckets[sr_adj_bucket(table, ip)]; adj != NULL; adj = next)
+    {
+        next = adj->next;
+        if (adj->ip != ip)
+        {
+            continue;
+        }
+        if (adj->valid)
+        {
+            sr_adj_set(adj, NULL, 0);
+        }
+        if (adj->refs == 0)
+        {
+            sr_adj_retire(table, adj);
+        }
+    }
+    pthread_mutex_unlock(&(table->lock));
+} /* -- sr_adj_invalidate -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_forget
+ *
+ * Retira la adyacencia sin resolver del vecino ip por ifindex cuando
+ * ninguna ruta la usa, por ejemplo cuando no contestó al ARP
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_forget(struct sr_adj_table* table, uint32_t ip, unsigned int ifindex)
+{
+    struct sr_adj* adj;
+
+    pthread_mutex_lock(&(table->lock));
+    adj = sr_adj_find(table, ip, ifindex);
+    if (adj != NULL && !adj->valid && adj->refs == 0)
+    {
+        sr_adj_retire(table, adj);
+    }
+    pthread_mutex_unlock(&(table->lock));
+} /* -- sr_adj_forget -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_reclaim
+ *
+ * Espera el período de gracia de las adyacencias retiradas y las deja
+ * libres para reusarse. Bloquea, así que se llama fuera de las
+ * secciones de lectura, desde el hilo de la caché ARP.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_reclaim(struct sr_adj_table* table)
+{
+    struct sr_adj* list;
+    struct sr_adj* adj;
+    struct sr_adj* next;
+
+    if (__atomic_load_n(&table->retired, __ATOMIC_RELAXED) == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&(table->lock));
+    list = table->retired;
+    table->retired = NULL;
+    pthread_mutex_unlock(&(table->lock));
+
+    sr_rcu_synchronize();
+
+    pthread_mutex_lock(&(table->lock));
+    for (adj = list; adj != NULL; adj = next)
+    {
+        next = adj->free_next;
+        __atomic_store_n(&adj->gen, adj->gen + 1, __ATOMIC_RELEASE);
+        adj->free_next = table->free;
+        table->free = adj;
+        table->recycled++;
+    }
+    pthread_mutex_unlock(&(table->lock));
+} /* -- sr_adj_reclaim -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_write_hdr
+ *
+ * Copia el cabezal Ethernet de la adyacencia al comienzo de frame.
+ * Devuelve 0, sin tocar la trama, si el vecino no está resuelto.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_adj_write_hdr(struct sr_adj* adj, uint8_t* frame)
+{
+    uint8_t l2[sizeof(adj->l2)];
+    unsigned int seq;
+    int valid;
+
+    do
+    {
+        seq = __atomic_load_n(&adj->seq, __ATOMIC_ACQUIRE);
+        valid = adj->valid;
+        memcpy(l2, adj->l2, sizeof(l2));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&adj->seq, __ATOMIC_RELAXED));
+
+    if (valid)
+    {
+        memcpy(frame, l2, sizeof(l2));
+    }
+    return valid;
+} /* -- sr_adj_write_hdr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_adj_print_stats
+ *
+ * Imprime la ocupación de la tabla y cuántas adyacencias se reusaron
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_adj_print_stats(struct sr_adj_table* table)
+{
+    pthread_mutex_lock(&(table->lock));
+    printf("Adyacencias: %u de %u, %lu reusadas, %lu sin lugar\n",
+           table->count, table->size, table->recycled, table->full);
+    pthread_mutex_unlock(&(table->lock));
+} /* -- sr_adj_print_stats -- */
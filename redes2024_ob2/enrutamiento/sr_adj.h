@@ -0,0 +1,89 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.h
+ *
+ * Descripción:
+ *
+ * Tabla de adyacencias. Una adyacencia es un vecino al que se reenvía:
+ * la IP del próximo salto, la interfaz de salida y el cabezal Ethernet
+ * de 14 bytes ya armado (MAC destino del vecino, MAC origen de la
+ * interfaz y tipo IP), listo para copiarse de una vez sobre la trama.
+ *
+ * Las rutas de la FIB con gateway apuntan a la adyacencia del gateway; la
+ * resolución ARP completa el cabezal y el vencimiento de la entrada ARP
+ * lo invalida. Como las rutas sólo guardan el puntero, una respuesta ARP
+ * actualiza a la vez todas las rutas que usan ese vecino.
+ *
+ * Las adyacencias salen de un arreglo de tamaño fijo, proporcional a la
+ * caché ARP (-a). Cada versión publicada de la FIB cuenta las que usan
+ * sus rutas; una adyacencia sin rutas deja la tabla cuando vence o se
+ * desaloja su entrada ARP, o cuando el vecino no contesta. No se reusa
+ * enseguida: espera un período de gracia RCU (sr_rcu.h), porque los
+ * paquetes en curso pueden tenerla, y su generación cambia al retirarla
+ * para que las cachés de destinos dejen de devolverla. Si no queda lugar
+ * se retiran las que nunca se resolvieron. El cabezal se lee sin locks
+ * con un contador de secuencia.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ADJ_H
+#define SR_ADJ_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#include "sr_protocol.h"
+
+struct sr_if;
+
+#define SR_ADJ_PER_NEIGHBOR  2   /* -- adyacencias por entrada de la caché ARP -- */
+#define SR_ADJ_SCAN          64  /* -- candidatas a retirar por búsqueda de lugar -- */
+
+struct sr_adj
+{
+    uint32_t ip;                            /* -- próximo salto (orden de red) -- */
+    unsigned int ifindex;                   /* -- interfaz de salida -- */
+    unsigned int seq;                       /* -- impar mientras se escribe el cabezal -- */
+    int valid;                              /* -- la MAC del vecino está resuelta -- */
+    uint8_t l2[sizeof(sr_ethernet_hdr_t)];  /* -- cabezal Ethernet armado -- */
+    unsigned int gen;                       /* -- cambia al retirarla y al reusarla -- */
+    unsigned int refs;                      /* -- rutas de las FIB vivas que la usan -- */
+    int linked;                             /* -- está en la tabla -- */
+    struct sr_adj* next;                    /* -- cadena del bucket -- */
+    struct sr_adj* free_next;               /* -- lista de retiradas o de libres -- */
+};
+
+struct sr_adj_table
+{
+    struct sr_adj** buckets;
+    unsigned int bits;                      /* -- log2 de la cantidad de buckets -- */
+    struct sr_adj* pool;
+    unsigned int size;
+    unsigned int used;                      /* -- del arreglo, alguna vez tomadas -- */
+    unsigned int count;                     /* -- en la tabla -- */
+    unsigned int hand;                      /* -- próxima candidata a retirar -- */
+    struct sr_adj* free;
+    struct sr_adj* retired;                 /* -- esperan el período de gracia -- */
+    unsigned long recycled;
+    unsigned long full;
+    pthread_mutex_t lock;                   /* -- sólo para escritores -- */
+};
+
+void sr_adj_init(struct sr_adj_table*, unsigned int size);
+struct sr_adj* sr_adj_get(struct sr_adj_table*, uint32_t ip, struct sr_if* iface);
+struct sr_adj* sr_adj_hold(struct sr_adj_table*, uint32_t ip, struct sr_if* iface);
+void sr_adj_release(struct sr_adj_table*, struct sr_adj*);
+void sr_adj_resolve(struct sr_adj_table*, uint32_t ip, unsigned int ifindex, const uint8_t* mac);
+void sr_adj_invalidate(struct sr_adj_table*, uint32_t ip);
+void sr_adj_forget(struct sr_adj_table*, uint32_t ip, unsigned int ifindex);
+void sr_adj_reclaim(struct sr_adj_table*);
+int sr_adj_write_hdr(struct sr_adj*, uint8_t* frame);
+void sr_adj_print_stats(struct sr_adj_table*);
+
+#endif /* -- SR_ADJ_H -- */
@@ -6,95 +6,71 @@
 #include <pthread.h>
 #include <sched.h>
 #include <string.h>
+#include <stddef.h>
+#include <sys/uio.h>
 #include "sr_arpcache.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
 #include "sr_utils.h"
+#include "sr_rcu.h"
+#include "sr_counters.h"
 
-/* Envía una solicitud ARP */
-void sr_arp_request_send(struct sr_instance *sr, uint32_t ip) {
+/* An ARP request to send */
+struct sr_arp_target {
+    uint32_t ip;
+    unsigned int ifindex;
+};
 
-  printf("$$$ -> Send ARP request.\n");
+/* What the timers that came due leave to do once the cache lock is
+   released */
+struct sr_arpcache_due {
+    struct sr_arpcache *cache;
+    struct sr_arp_target *resend; /* ARP requests to send */
+    unsigned int num_resend;
+    unsigned int max_resend;
+    struct sr_arpreq *expired;  /* Unlinked requests that ran out of tries */
+};
 
-  /* Obtengo memoria para el paquete */
-  int arpPacketLen = sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t);
-  uint8_t *arpPacket = malloc(arpPacketLen);
+static void sr_arpentry_expire(struct sr_timer *t, void *ctx);
+static void sr_arpreq_retry(struct sr_timer *t, void *ctx);
 
-  /* Construyo el cabezal Ethernet y agrego dirección de destino (broadcast)*/
-  sr_ethernet_hdr_t *ethHdr = (struct sr_ethernet_hdr *) arpPacket;
-  memcpy(ethHdr->ether_dhost, generate_ethernet_addr(255), ETHER_ADDR_LEN);
+/* Envía una solicitud ARP por ip sólo por la interfaz ifindex, desde la
+   plantilla de la interfaz: la IP buscada es su último campo y va aparte */
+void sr_arp_request_send(struct sr_instance *sr, uint32_t ip, unsigned int ifindex) {
+  struct sr_if *iface = sr_get_interface_by_index(sr, ifindex);
+  struct iovec iov[2];
 
-  /* Envío la solicitud ARP desde cada interfaz */
-  struct sr_if *currIf = sr->if_list;
-  uint8_t *copyPacket;
-  while (currIf != NULL) {
-      printf("$$$$ -> Send ARP request from interface %s.\n", currIf->name);
+  if (iface == NULL)
+      return;
 
-      /* Agrero la dirección de origen y el tipo de paquete */
-      memcpy(ethHdr->ether_shost, (uint8_t *) currIf->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
-      ethHdr->ether_type = htons(ethertype_arp);
-
-      /* Construyo el cabezal ARP */
-      sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *) (arpPacket + sizeof(sr_ethernet_hdr_t));
-      arpHdr->ar_hrd = htons(1);
-      arpHdr->ar_pro = htons(2048);
-      arpHdr->ar_hln = 6;
-      arpHdr->ar_pln = 4;
-      arpHdr->ar_op = htons(arp_op_request);
-      memcpy(arpHdr->ar_sha, currIf->addr, ETHER_ADDR_LEN);
-      memcpy(arpHdr->ar_tha, (char *) generate_ethernet_addr(0), ETHER_ADDR_LEN);
-      arpHdr->ar_sip = currIf->ip;
-      arpHdr->ar_tip = ip;
-
-      copyPacket = malloc(arpPacketLen);
-      memcpy(copyPacket, ethHdr, arpPacketLen);
-
-      print_hdrs(copyPacket, arpPacketLen);
-      sr_send_packet(sr, copyPacket, arpPacketLen, currIf->name);
-
-      currIf = currIf->next;
+  sr_log_event(ARP, SR_LOG_INFO, SR_EV_ARP_REQUEST, ip, ifindex);
+  if (sr_log_enabled(ARP, SR_LOG_TRACE)) {
+      uint8_t arpPacket[sizeof(iface->arp_req)];
+      memcpy(arpPacket, iface->arp_req, sizeof(arpPacket));
+      ((sr_arp_hdr_t *) (arpPacket + sizeof(sr_ethernet_hdr_t)))->ar_tip = ip;
+      sr_log_dump(ARP, arpPacket, sizeof(arpPacket));
   }
-  printf("$$$ -> Send ARP request processing complete.\n");
-}
 
-/* 
-  This function gets called every second. For each request sent out, we keep
-  checking whether we should resend an request or destroy the arp request.
-  See the comments in the header file for an idea of what it should look like.
-*/
-void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
-   struct sr_arpreq *currReq = sr->cache.requests;
-   struct sr_arpreq *nextReq;
-
-   while (currReq != NULL)
-   {
-       nextReq = currReq->next;
-       handle_arpreq(sr, currReq);
-       currReq = nextReq;
-   }
+  iov[0].iov_base = iface->arp_req;
+  iov[0].iov_len = sizeof(iface->arp_req) - sizeof(uint32_t);
+  iov[1].iov_base = &ip;
+  iov[1].iov_len = sizeof(uint32_t);
+  sr_send_packetv(sr, iov, 2, ifindex);
 }
 
 /*
-  Handle ARP request if necessary.
+  Handle ARP request if necessary: a new request is sent right away and its
+  timer takes care of the retries.
 */
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req)
 {
-    time_t now = time(NULL);
-
-    if (difftime(time(0), req->sent) > 1.0)
+    if (req->times_sent == 0)
     {
-        if (req->times_sent >= 5)
-        {
-            host_unreachable(sr, req);
-            sr_arpreq_destroy(&(sr->cache), req);
-        }
-        else
-        {
-            sr_arp_request_send(sr, req->ip);
-            req->sent = now;
-            req->times_sent++;
-        }
+        sr_arp_request_send(sr, req->ip, req->ifindex);
+        req->sent = time(NULL);
+        req->times_sent++;
+        sr_timer_add(&(sr->cache.timers), &(req->timer), sr_timer_now_ms() + SR_ARPREQ_RETRY_MS);
     }
 }
 
@@ -103,40 +79,166 @@ void host_unreachable(struct sr_instance *sr, struct sr_arpreq *req) {
 
     int ipOffset = sizeof(sr_ethernet_hdr_t);
 
+    sr_rcu_read_lock();
     while (currPacket != NULL) {
+        sr_count_drop(SR_DROP_ARP_FAIL);
         sr_send_icmp_error_packet(3, 1, sr,
                                ((sr_ip_hdr_t*) (currPacket->buf + ipOffset))->ip_src,
-                               currPacket->buf + ipOffset);
+                               currPacket->buf + ipOffset, 0);
         currPacket = currPacket->next;
     }
+    sr_rcu_read_unlock();
 }
 
 /* You should not need to touch the rest of this code. */
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
-    
-    struct sr_arpentry *entry = NULL, *copy = NULL;
-    
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+/* Home slot of an IP (multiplicative hash). */
+static uint32_t sr_arpcache_home(struct sr_arpcache *cache, uint32_t ip) {
+    return (ip * 2654435761U) >> (32 - cache->bits);
+}
+
+/* Writers, with the cache lock held, bracket every change of the table so
+   that lookups retry instead of reading it half done. */
+static void sr_arpcache_write_begin(struct sr_arpcache *cache) {
+    __atomic_store_n(&(cache->seq), cache->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void sr_arpcache_write_end(struct sr_arpcache *cache) {
+    __atomic_store_n(&(cache->seq), cache->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Slot holding the IP, or -1. Call with the cache lock held. */
+static long sr_arpcache_find(struct sr_arpcache *cache, uint32_t ip) {
+    uint32_t i;
+
+    for (i = sr_arpcache_home(cache, ip); cache->entries[i].valid; i = (i + 1) & cache->mask) {
+        if (cache->entries[i].ip == ip)
+            return i;
+    }
+    return -1;
+}
+
+/* Empties slot i, moving back the entries after it that probed past it so
+   that lookups never stop early. Invalidates the entry's adjacency. */
+static void sr_arpcache_remove(struct sr_arpcache *cache, uint32_t i) {
+    uint32_t j = i, home;
+
+    if (cache->adj)
+        sr_adj_invalidate(cache->adj, cache->entries[i].ip);
+    sr_timer_del(&(cache->timers), &(cache->entries[i].timer));
+
+    for (;;) {
+        j = (j + 1) & cache->mask;
+        if (!cache->entries[j].valid)
+            break;
+        /* The entry in j can fill i unless its home is in (i, j] */
+        home = sr_arpcache_home(cache, cache->entries[j].ip);
+        if (((j - home) & cache->mask) >= ((j - i) & cache->mask)) {
+            cache->entries[i] = cache->entries[j];
+            sr_timer_moved(&(cache->entries[i].timer));
+            i = j;
         }
     }
-    
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
+    cache->entries[i].valid = 0;
+    cache->count--;
+}
+
+/* CLOCK: evicts the first entry not used since the hand last passed it. */
+static void sr_arpcache_evict(struct sr_arpcache *cache) {
+    struct sr_arpentry *e;
+
+    for (;;) {
+        e = &(cache->entries[cache->hand]);
+        if (e->valid) {
+            if (!e->referenced) {
+                sr_arpcache_remove(cache, cache->hand);
+                cache->evictions++;
+                return;
+            }
+            e->referenced = 0;
+        }
+        cache->hand = (cache->hand + 1) & cache->mask;
     }
-        
+}
+
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   Copies the entry into *entry; no lock, the sequence counter tells if a
+   writer changed the table meanwhile. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip, struct sr_arpentry *entry) {
+    struct sr_arpentry *e;
+    unsigned int seq;
+    uint32_t i, n;
+    int found;
+
+    do {
+        seq = __atomic_load_n(&(cache->seq), __ATOMIC_ACQUIRE);
+        found = 0;
+        e = NULL;
+        /* Bounded: a writer may leave no empty slot in sight mid-change */
+        for (i = sr_arpcache_home(cache, ip), n = 0; n <= cache->mask; i = (i + 1) & cache->mask, n++) {
+            e = &(cache->entries[i]);
+            if (!e->valid)
+                break;
+            if (e->ip == ip) {
+                memcpy(entry, e, sizeof(struct sr_arpentry));
+                found = 1;
+                break;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&(cache->seq), __ATOMIC_RELAXED));
+
+    /* A hint for CLOCK, only written when it changes */
+    if (found && !entry->referenced)
+        __atomic_store_n(&(e->referenced), 1, __ATOMIC_RELAXED);
+    return found;
+}
+
+/* Fills in the adjacency from the cache if it is not resolved yet. The
+   lock-free lookup only rules out a miss; the MAC is copied with the
+   cache lock held and the entry still present, so an expiry cannot slip
+   in between and leave the adjacency resolved with a stale MAC. */
+int sr_arpcache_fill_adj(struct sr_instance *sr, struct sr_adj *adj) {
+    struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpentry entry;
+    long i;
+
+    if (adj == NULL)
+        return 0;
+    if (adj->valid)
+        return 1;
+
+    if (!sr_arpcache_lookup(cache, adj->ip, &entry))
+        return 0;
+
+    pthread_mutex_lock(&(cache->lock));
+    i = sr_arpcache_find(cache, adj->ip);
+    if (i >= 0)
+        sr_adj_resolve(&(sr->adj), adj->ip, adj->ifindex, cache->entries[i].mac);
     pthread_mutex_unlock(&(cache->lock));
-    
-    return copy;
+    return i >= 0;
+}
+
+/* Unlinks the packet at the head of the request's list. */
+static struct sr_packet *sr_arpreq_unlink_head(struct sr_arpreq *req) {
+    struct sr_packet *pkt = req->packets;
+
+    req->packets = pkt->next;
+    if (req->packets == NULL)
+        req->last = NULL;
+    req->num_packets--;
+    req->bytes -= pkt->len;
+    return pkt;
+}
+
+/* Drops the packet at the head of the request's list. */
+static void sr_arpreq_drop_head(struct sr_arpreq *req, unsigned int reason) {
+    struct sr_packet *pkt = sr_arpreq_unlink_head(req);
+
+    sr_count_drop(reason);
+    free(pkt->buf);
+    free(pkt);
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
@@ -149,13 +251,13 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
-                                       char *iface)
+                                       unsigned int ifindex)
 {
     pthread_mutex_lock(&(cache->lock));
     
     struct sr_arpreq *req;
     for (req = cache->requests; req != NULL; req = req->next) {
-        if (req->ip == ip) {
+        if (req->ip == ip && req->ifindex == ifindex) {
             break;
         }
     }
@@ -164,21 +266,44 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
     if (!req) {
         req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
         req->ip = ip;
+        req->ifindex = ifindex;
+        sr_timer_init(&(req->timer), sr_arpreq_retry);
         req->next = cache->requests;
         cache->requests = req;
     }
     
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
+    /* Add the packet at the end of the list of packets for this request */
+    if (packet && packet_len) {
         struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
+        uint64_t now = sr_codel_now();
         
         new_pkt->buf = (uint8_t *)malloc(packet_len);
         memcpy(new_pkt->buf, packet, packet_len);
         new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = req->packets;
-        req->packets = new_pkt;
+        new_pkt->ifindex = ifindex;
+        new_pkt->queued = now;
+        new_pkt->next = NULL;
+        if (req->last)
+            req->last->next = new_pkt;
+        else
+            req->packets = new_pkt;
+        req->last = new_pkt;
+        req->num_packets++;
+        req->bytes += packet_len;
+
+        /* A slow resolution does not pile up stale packets: CoDel drops
+           from the head those that waited too long (never marks, they
+           cannot leave yet), and over the limit the oldest one goes */
+        while (req->packets != new_pkt &&
+               sr_codel_dequeue(&(req->codel), NULL, req->packets->len, req->packets->queued,
+                                now, req->bytes - req->packets->len) == SR_CODEL_DROP) {
+            cache->codel_drops++;
+            sr_arpreq_drop_head(req, SR_DROP_CODEL);
+        }
+        while (req->num_packets > SR_ARPREQ_LIMIT) {
+            cache->full_drops++;
+            sr_arpreq_drop_head(req, SR_DROP_ARPQ_FULL);
+        }
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -192,13 +317,14 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip)
+                                     uint32_t ip,
+                                     unsigned int ifindex)
 {
     pthread_mutex_lock(&(cache->lock));
     
     struct sr_arpreq *req, *prev = NULL, *next = NULL; 
     for (req = cache->requests; req != NULL; req = req->next) {
-        if (req->ip == ip) {            
+        if (req->ip == ip && req->ifindex == ifindex) {            
             if (prev) {
                 next = req->next;
                 prev->next = next;
@@ -212,19 +338,29 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         }
         prev = req;
     }
+    if (req)
+        sr_timer_del(&(cache->timers), &(req->timer));
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
-    }
-    
-    if (i != SR_ARPCACHE_SZ) {
-        memcpy(cache->entries[i].mac, mac, 6);
+    /* A known IP keeps its slot and takes the new MAC; a new one may
+       need room first */
+    sr_arpcache_write_begin(cache);
+    long i = sr_arpcache_find(cache, ip);
+    if (i < 0) {
+        if (cache->count >= cache->size)
+            sr_arpcache_evict(cache);
+        for (i = sr_arpcache_home(cache, ip); cache->entries[i].valid; i = (i + 1) & cache->mask)
+            ;
         cache->entries[i].ip = ip;
-        cache->entries[i].added = time(NULL);
         cache->entries[i].valid = 1;
+        sr_timer_init(&(cache->entries[i].timer), sr_arpentry_expire);
+        cache->count++;
     }
+    memcpy(cache->entries[i].mac, mac, 6);
+    cache->entries[i].added = time(NULL);
+    cache->entries[i].referenced = 1;
+    sr_timer_add(&(cache->timers), &(cache->entries[i].timer),
+                 sr_timer_now_ms() + (uint64_t)(SR_ARPCACHE_TO * 1000));
+    sr_arpcache_write_end(cache);
     
     pthread_mutex_unlock(&(cache->lock));
     
@@ -237,6 +373,8 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
     pthread_mutex_lock(&(cache->lock));
     
     if (entry) {
+        sr_timer_del(&(cache->timers), &(entry->timer));
+
         struct sr_arpreq *req, *prev = NULL, *next = NULL; 
         for (req = cache->requests; req != NULL; req = req->next) {
             if (req == entry) {                
@@ -260,8 +398,6 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
             nxt = pkt->next;
             if (pkt->buf)
                 free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
             free(pkt);
         }
         
@@ -271,13 +407,45 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
     pthread_mutex_unlock(&(cache->lock));
 }
 
+/* Takes the packet at the head of the request's list to be sent; NULL if
+   CoDel dropped it. */
+struct sr_packet *sr_arpreq_pop(struct sr_arpcache *cache, struct sr_arpreq *req) {
+    struct sr_packet *pkt = sr_arpreq_unlink_head(req);
+
+    switch (sr_codel_dequeue(&(req->codel), pkt->buf, pkt->len, pkt->queued,
+                             sr_codel_now(), req->bytes)) {
+        case SR_CODEL_DROP:
+            cache->codel_drops++;
+            sr_count_drop(SR_DROP_CODEL);
+            free(pkt->buf);
+            free(pkt);
+            return NULL;
+        case SR_CODEL_MARK:
+            cache->codel_marks++;
+            break;
+    }
+    pkt->next = NULL;
+    return pkt;
+}
+
+/* Prints table occupancy and evictions, CoDel drops and marks and drops
+   over the limit. */
+void sr_arpcache_print_stats(struct sr_arpcache *cache) {
+    pthread_mutex_lock(&(cache->lock));
+    printf("Tabla ARP: %u de %u vecinos en %u posiciones, %lu desalojados\n",
+           cache->count, cache->size, cache->mask + 1, cache->evictions);
+    printf("Pendientes de ARP: CoDel %lu descartes, %lu marcas; %lu descartes sobre %d por solicitud\n",
+           cache->codel_drops, cache->codel_marks, cache->full_drops, SR_ARPREQ_LIMIT);
+    pthread_mutex_unlock(&(cache->lock));
+}
+
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
     fprintf(stderr, "-----------------------------------------------------------\n");
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+    uint32_t i;
+    for (i = 0; i <= cache->mask; i++) {
         struct sr_arpentry *cur = &(cache->entries[i]);
         unsigned char *mac = cur->mac;
         fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
@@ -287,13 +455,27 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
 }
 
 /* Initialize table + table lock. Returns 0 on success. */
-int sr_arpcache_init(struct sr_arpcache *cache) {  
-    /* Seed RNG to kick out a random entry if all entries full. */
-    srand(time(NULL));
+int sr_arpcache_init(struct sr_arpcache *cache, unsigned int size,
+                     struct sr_adj_table *adj) {
+    /* At most half full: room for size neighbors in a power of 2 */
+    cache->bits = 1;
+    while ((1U << cache->bits) < 2 * size)
+        cache->bits++;
+    cache->mask = (1U << cache->bits) - 1;
+    cache->size = size;
+    cache->count = 0;
+    cache->hand = 0;
+    cache->seq = 0;
+    cache->evictions = 0;
+    cache->adj = adj;
+    sr_timer_wheel_init(&(cache->timers), sr_timer_now_ms());
     
     /* Invalidate all entries */
-    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->entries = (struct sr_arpentry *) calloc(cache->mask + 1, sizeof(struct sr_arpentry));
+    if (cache->entries == NULL)
+        return -1;
     cache->requests = NULL;
+    cache->codel_drops = cache->codel_marks = cache->full_drops = 0;
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
@@ -305,34 +487,96 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
 
 /* Destroys table + table lock. Returns 0 on success. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
+    free(cache->entries);
+    cache->entries = NULL;
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+/* Entry timer: the mapping timed out. */
+static void sr_arpentry_expire(struct sr_timer *t, void *ctx) {
+    struct sr_arpcache_due *due = ctx;
+    struct sr_arpcache *cache = due->cache;
+    struct sr_arpentry *entry = (struct sr_arpentry *) ((char *) t - offsetof(struct sr_arpentry, timer));
+
+    sr_arpcache_write_begin(cache);
+    sr_arpcache_remove(cache, entry - cache->entries);
+    sr_arpcache_write_end(cache);
+}
+
+/* Request timer: sends the request again or, after SR_ARPREQ_TRIES sends,
+   unlinks it so that its packets get an ICMP host unreachable. */
+static void sr_arpreq_retry(struct sr_timer *t, void *ctx) {
+    struct sr_arpcache_due *due = ctx;
+    struct sr_arpreq *req = (struct sr_arpreq *) ((char *) t - offsetof(struct sr_arpreq, timer));
+    struct sr_arpreq **pp;
+    struct sr_arp_target *resend;
+
+    if (req->times_sent >= SR_ARPREQ_TRIES) {
+        for (pp = &(due->cache->requests); *pp != req; pp = &((*pp)->next))
+            ;
+        *pp = req->next;
+        req->next = due->expired;
+        due->expired = req;
+        if (due->cache->adj)
+            sr_adj_forget(due->cache->adj, req->ip, req->ifindex);
+        return;
+    }
+
+    if (due->num_resend == due->max_resend) {
+        resend = (struct sr_arp_target *) realloc(due->resend, 2 * (due->max_resend + 8) * sizeof(struct sr_arp_target));
+        if (resend != NULL) {
+            due->resend = resend;
+            due->max_resend = 2 * (due->max_resend + 8);
+        }
+    }
+    if (due->num_resend < due->max_resend) {
+        due->resend[due->num_resend].ip = req->ip;
+        due->resend[due->num_resend].ifindex = req->ifindex;
+        due->num_resend++;
+    }
+    req->sent = time(NULL);
+    req->times_sent++;
+    sr_timer_add(&(due->cache->timers), t, sr_timer_now_ms() + SR_ARPREQ_RETRY_MS);
+}
+
+/* Thread which advances the timer wheel: entries time out SR_ARPCACHE_TO
+   seconds after they were added and requests are resent every
+   SR_ARPREQ_RETRY_MS. What comes due is sent without the cache lock. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
     struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpcache_due due;
+    struct sr_arpreq *req, *next;
+    struct timespec tick;
+    unsigned int i;
+
+    tick.tv_sec = 0;
+    tick.tv_nsec = SR_ARPCACHE_TICK_MS * 1000000L;
+    memset(&due, 0, sizeof(due));
+    due.cache = cache;
     
     while (1) {
-        sleep(1.0);
+        nanosleep(&tick, NULL);
         
         pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
+        sr_timer_run(&(cache->timers), sr_timer_now_ms(), &due);
+        pthread_mutex_unlock(&(cache->lock));
+
+        for (i = 0; i < due.num_resend; i++)
+            sr_arp_request_send(sr, due.resend[i].ip, due.resend[i].ifindex);
+        due.num_resend = 0;
+
+        for (req = due.expired; req != NULL; req = next) {
+            next = req->next;
+            host_unreachable(sr, req);
+            sr_arpreq_destroy(cache, req);
         }
-        
-        sr_arpcache_sweepreqs(sr);
+        due.expired = NULL;
 
-        pthread_mutex_unlock(&(cache->lock));
+        /* Adjacencies that left the table are reused after a grace period */
+        if (cache->adj)
+            sr_adj_reclaim(cache->adj);
     }
     
     return NULL;
 }
-
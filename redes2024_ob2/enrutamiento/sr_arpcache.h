@@ -2,18 +2,34 @@
    request queue, and ARP cache entries. The ARP request queue holds data about
    an outgoing ARP cache request and the packets that are waiting on a reply
    to that ARP cache request. The ARP cache entries hold IP->MAC mappings and
-   are timed out every SR_ARPCACHE_TO seconds.
+   are timed out SR_ARPCACHE_TO seconds after they are added.
+
+   Entry expiry and request retries are timers on a hierarchical timing wheel
+   (sr_timer.h) with millisecond resolution, so nothing scans the table or
+   the request list. A thread advances the wheel every SR_ARPCACHE_TICK_MS
+   with the cache lock held; the ARP requests and ICMP errors that come due
+   are sent after releasing it.
+
+   The cache entries live in an open-addressing hash table (linear probing,
+   backward-shift deletion, so no tombstones) sized at startup for a number
+   of neighbors and kept at most half full. One entry per IP: a new mapping
+   for a known IP replaces the old one. When the table holds as many
+   neighbors as it was sized for, a CLOCK hand evicts an entry that no
+   lookup has used since the hand last passed it, and the adjacency built
+   from it is invalidated.
+
+   Lookups take no lock: writers (insert, expiry, eviction) are serialized
+   by the cache lock and bump a sequence counter around every change, and
+   a reader copies the entry into its own struct and retries if the
+   counter was odd or moved meanwhile.
 
    Pseudocode for use of these structures follows.
 
    --
 
    # When sending packet to next_hop_ip
-   entry = arpcache_lookup(next_hop_ip)
-
-   if entry:
+   if arpcache_lookup(next_hop_ip, &entry):
        use next_hop_ip->mac mapping in entry to send the packet
-       free entry
    else:
        req = arpcache_queuereq(next_hop_ip, packet, len)
        handle_arpreq(req)
@@ -40,14 +56,25 @@
 #include <time.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_codel.h"
+#include "sr_timer.h"
+
+struct sr_adj;
+struct sr_adj_table;
 
-#define SR_ARPCACHE_SZ    100  
+#define SR_ARPCACHE_SZ    1024  /* Default number of neighbors (-a) */
+#define SR_ARPCACHE_MAX   (1 << 20)
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_TICK_MS 10  /* How often the timer wheel is advanced */
+#define SR_ARPREQ_RETRY_MS 1000 /* Between two sends of one request */
+#define SR_ARPREQ_TRIES   5     /* Sends before giving up */
+#define SR_ARPREQ_LIMIT   64    /* Most packets waiting on one request */
 
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    unsigned int ifindex;       /* The outgoing interface */
+    uint64_t queued;            /* sr_codel_now() when it was queued */
     struct sr_packet *next;
 };
 
@@ -56,68 +83,116 @@ struct sr_arpentry {
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
     int valid;
+    int referenced;             /* Used since the CLOCK hand last passed */
+    struct sr_timer timer;      /* Expiry */
 };
 
 struct sr_arpreq {
     uint32_t ip;
+    unsigned int ifindex;       /* Interface the request is sent on */
     time_t sent;                /* Last time this ARP request was sent. You 
                                    should update this. If the ARP request was 
                                    never sent, will be 0. */
     uint32_t times_sent;        /* Number of times this request was sent. You 
                                    should update this. */
-    struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
+    struct sr_packet *packets;  /* List of pkts waiting on this req to finish,
+                                   oldest first */
+    struct sr_packet *last;     /* Newest packet, where new ones are added */
+    unsigned int num_packets;
+    unsigned int bytes;         /* Bytes waiting, the CoDel backlog */
+    struct sr_codel codel;      /* Drops packets that waited too long */
+    struct sr_timer timer;      /* Next send, or giving up */
     struct sr_arpreq *next;
 };
 
 struct sr_arpcache {
-    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct sr_arpentry *entries; /* Hash table of mask + 1 slots */
+    uint32_t mask;
+    unsigned int bits;          /* log2 of the number of slots */
+    unsigned int size;          /* Most neighbors held */
+    unsigned int count;
+    uint32_t hand;              /* CLOCK eviction hand */
+    unsigned int seq;           /* Odd while a writer changes the table */
+    unsigned long evictions;
+    struct sr_adj_table *adj;   /* Adjacencies invalidated with their entry */
+    struct sr_timer_wheel timers; /* Entry expiry and request retries */
     struct sr_arpreq *requests;
+    unsigned long codel_drops;  /* CoDel totals over all the requests */
+    unsigned long codel_marks;
+    unsigned long full_drops;   /* Packets over SR_ARPREQ_LIMIT */
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
 };
 
-void sr_arpcache_sweepreqs(struct sr_instance *sr);
+/* Sends the first ARP request of a new request and arms its retry timer;
+   later retries and giving up are left to the timer. Call with the cache
+   lock held. */
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req);
 void host_unreachable(struct sr_instance *sr, struct sr_arpreq *req);
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   Copies the entry into *entry and returns 1 if found, 0 otherwise. Takes
+   no lock and allocates nothing. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip, struct sr_arpentry *entry);
+
+/* Fills in the adjacency from the cache if it is not resolved yet and the
+   cache has a mapping for its IP. Returns 1 if the adjacency is resolved. */
+int sr_arpcache_fill_adj(struct sr_instance *sr, struct sr_adj *adj);
 
-/* Adds an ARP request to the ARP request queue. If the request is already on
+/* Adds an ARP request to the ARP request queue. Requests are kept per
+   (interface, IP): ifindex is the interface the packet goes out of, and
+   the only one the ARP request is sent on. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
    that corresponds to this ARP request. The packet argument should not be
    freed by the caller.
 
+   Packets are kept in arrival order. Those at the head of the list that
+   CoDel finds have waited too long are dropped, and so is the oldest one
+   when the request already holds SR_ARPREQ_LIMIT packets.
+
    A pointer to the ARP request is returned; it should be freed. The caller
    can remove the ARP request from the queue by calling sr_arpreq_destroy. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
-                         char *iface);
+                         unsigned int ifindex);
 
 /* This method performs two functions:
-   1) Looks up this IP in the request queue. If it is found, returns a pointer
-      to the sr_arpreq with this IP. Otherwise, returns NULL.
+   1) Looks up this IP on interface ifindex, where the mapping was learnt,
+      in the request queue. If it is found, returns a pointer to the
+      sr_arpreq with this IP. Otherwise, returns NULL.
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip);
+                                     uint32_t ip,
+                                     unsigned int ifindex);
 
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 
+/* Takes the packet at the head of the request's list to be sent. Returns
+   NULL when CoDel drops it (the packet is freed) and the packet, possibly
+   marked ECN CE, otherwise; the caller frees it. Call with the cache lock
+   held. */
+struct sr_packet *sr_arpreq_pop(struct sr_arpcache *cache, struct sr_arpreq *req);
+
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
+/* Prints table occupancy and evictions, CoDel drops and marks and drops
+   over the limit. */
+void sr_arpcache_print_stats(struct sr_arpcache *cache);
+
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
-   a destructor, and a cleanup thread times out cache entries every 15
-   seconds. */
+   a destructor, and a cleanup thread runs the timers that time out cache
+   entries and resend requests. The table holds up to size neighbors; the adjacency of an
+   entry that expires or is evicted is invalidated in adj. */
 
-int   sr_arpcache_init(struct sr_arpcache *cache);
+int   sr_arpcache_init(struct sr_arpcache *cache, unsigned int size,
+                       struct sr_adj_table *adj);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
 
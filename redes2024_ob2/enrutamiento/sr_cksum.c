@@ -0,0 +1,190 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.c
+ *
+ * Descripción:
+ *
+ * Núcleos de la suma de Internet y su selección en tiempo de ejecución,
+ * ver sr_cksum.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "sr_cksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SR_CKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+/* Las sumas vectoriales acumulan en carriles de 32 bits; cada bloque
+   suma a lo sumo 2 * SR_CKSUM_BLOCK palabras de 16 bits por carril */
+#define SR_CKSUM_BLOCK 4096
+
+static uint16_t (*sr_cksum_fn)(const void*, int) = sr_cksum_sum_scalar;
+static const char* sr_cksum_name = "scalar64";
+
+/* Suma con acarreo circular en 64 bits */
+static uint64_t sr_cksum_add64(uint64_t acc, uint64_t v)
+{
+    acc += v;
+    return acc + (acc < v);
+}
+
+/* Reduce una suma de 64 bits a 16 bits con acarreo circular */
+static uint16_t sr_cksum_fold(uint64_t acc)
+{
+    acc = (acc >> 32) + (acc & 0xffffffffU);
+    acc = (acc >> 32) + (acc & 0xffffffffU);
+    acc = (acc >> 16) + (acc & 0xffff);
+    acc = (acc >> 16) + (acc & 0xffff);
+    return (uint16_t)acc;
+}
+
+/* Suma los bytes que quedan (menos de 8) completando con ceros */
+static uint64_t sr_cksum_tail(uint64_t acc, const uint8_t* data, int len)
+{
+    uint64_t v = 0;
+    memcpy(&v, data, len);
+    return sr_cksum_add64(acc, v);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_scalar
+ *
+ * Suma en complemento a uno de len bytes, de a 64 bits
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_sum_scalar(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    uint64_t acc = 0;
+    uint64_t v;
+
+    for (; len >= 8; data += 8, len -= 8)
+    {
+        memcpy(&v, data, sizeof(v));
+        acc = sr_cksum_add64(acc, v);
+    }
+
+    return sr_cksum_fold(sr_cksum_tail(acc, data, len));
+} /* -- sr_cksum_sum_scalar -- */
+
+#ifdef SR_CKSUM_X86
+
+__attribute__((target("sse2")))
+static uint16_t sr_cksum_sum_sse2(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t lanes[4];
+    uint64_t acc = 0, v;
+    __m128i sum, w;
+    int n, i;
+
+    while (len >= 16)
+    {
+        sum = _mm_setzero_si128();
+        for (n = 0; n < SR_CKSUM_BLOCK && len >= 16; n++, data += 16, len -= 16)
+        {
+            w = _mm_loadu_si128((const __m128i*)data);
+            sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(w, zero));
+            sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(w, zero));
+        }
+        _mm_storeu_si128((__m128i*)lanes, sum);
+        for (i = 0; i < 4; i++)
+        {
+            acc += lanes[i];
+        }
+    }
+
+    for (; len >= 8; data += 8, len -= 8)
+    {
+        memcpy(&v, data, sizeof(v));
+        acc = sr_cksum_add64(acc, v);
+    }
+
+    return sr_cksum_fold(sr_cksum_tail(acc, data, len));
+}
+
+__attribute__((target("avx2")))
+static uint16_t sr_cksum_sum_avx2(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t lanes[8];
+    uint64_t acc = 0, v;
+    __m256i sum, w;
+    int n, i;
+
+    while (len >= 32)
+    {
+        sum = _mm256_setzero_si256();
+        for (n = 0; n < SR_CKSUM_BLOCK && len >= 32; n++, data += 32, len -= 32)
+        {
+            w = _mm256_loadu_si256((const __m256i*)data);
+            sum = _mm256_add_epi32(sum, _mm256_unpacklo_epi16(w, zero));
+            sum = _mm256_add_epi32(sum, _mm256_unpackhi_epi16(w, zero));
+        }
+        _mm256_storeu_si256((__m256i*)lanes, sum);
+        for (i = 0; i < 8; i++)
+        {
+            acc += lanes[i];
+        }
+    }
+
+    for (; len >= 8; data += 8, len -= 8)
+    {
+        memcpy(&v, data, sizeof(v));
+        acc = sr_cksum_add64(acc, v);
+    }
+
+    return sr_cksum_fold(sr_cksum_tail(acc, data, len));
+}
+
+#endif /* SR_CKSUM_X86 */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_init
+ *
+ * Elige el núcleo más ancho que soporta el procesador. Se llama una vez
+ * al arrancar, antes de crear hilos.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_cksum_init(void)
+{
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        sr_cksum_fn = sr_cksum_sum_avx2;
+        sr_cksum_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        sr_cksum_fn = sr_cksum_sum_sse2;
+        sr_cksum_name = "sse2";
+    }
+#endif
+} /* -- sr_cksum_init -- */
+
+/* Nombre del núcleo elegido, para los mensajes de arranque */
+const char* sr_cksum_impl(void)
+{
+    return sr_cksum_name;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum
+ *
+ * Suma en complemento a uno de len bytes con el núcleo elegido. El
+ * resultado vale 0 sólo si todos los bytes son 0.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_sum(const void* data, int len)
+{
+    return sr_cksum_fn(data, len);
+} /* -- sr_cksum_sum -- */
@@ -0,0 +1,32 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.h
+ *
+ * Descripción:
+ *
+ * Suma en complemento a uno de Internet (RFC 1071) sobre palabras de 64
+ * bits, con versiones SSE2 y AVX2 que se eligen al arrancar según lo que
+ * informa CPUID. cksum() (sr_utils.c) se apoya en ella.
+ *
+ * La suma se hace sobre palabras de 16 bits en el orden de la máquina;
+ * como la suma en complemento a uno no depende del orden de bytes, el
+ * complemento del resultado puede guardarse directo en el paquete.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CKSUM_H
+#define SR_CKSUM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+void sr_cksum_init(void);
+const char* sr_cksum_impl(void);
+uint16_t sr_cksum_sum(const void* data, int len);
+uint16_t sr_cksum_sum_scalar(const void* data, int len);
+
+#endif /* -- SR_CKSUM_H -- */
@@ -0,0 +1,145 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_codel.c
+ *
+ * Descripción:
+ *
+ * CoDel, ver sr_codel.h. Sigue el pseudocódigo del RFC 8289 pero decide
+ * de a un paquete: quien desencola llama a sr_codel_dequeue por cada uno.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include <netinet/in.h>
+
+#include "sr_codel.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+
+#define SR_IP_ECN_MASK  0x03
+#define SR_IP_ECN_CE    0x03
+
+uint64_t sr_codel_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Próximo descarte: cada vez más seguido mientras la cola no baje */
+static uint64_t sr_codel_control_law(uint64_t t, uint32_t count)
+{
+    return t + (uint64_t)(SR_CODEL_INTERVAL / sqrt((double)count));
+}
+
+/* La espera estuvo por encima del objetivo un intervalo entero */
+static int sr_codel_ok_to_drop(struct sr_codel* c, uint64_t sojourn, uint64_t now,
+                               unsigned int backlog)
+{
+    if (sojourn < SR_CODEL_TARGET || backlog <= SR_CODEL_MAXPACKET)
+    {
+        c->first_above = 0;
+        return 0;
+    }
+    if (c->first_above == 0)
+    {
+        c->first_above = now + SR_CODEL_INTERVAL;
+        return 0;
+    }
+    return now >= c->first_above;
+}
+
+/* Marca CE un datagrama ECT; devuelve 0 si no admite ECN */
+static int sr_codel_mark(uint8_t* frame, unsigned int len)
+{
+    sr_ethernet_hdr_t* eHdr = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ipHdr = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    uint16_t old, new_;
+
+    if (frame == NULL || len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+        ntohs(eHdr->ether_type) != ethertype_ip || (ipHdr->ip_tos & SR_IP_ECN_MASK) == 0)
+    {
+        return 0;
+    }
+
+    /* TOS comparte su palabra de 16 bits con versión y largo del cabezal */
+    memcpy(&old, ipHdr, sizeof(old));
+    ipHdr->ip_tos |= SR_IP_ECN_CE;
+    memcpy(&new_, ipHdr, sizeof(new_));
+    ipHdr->ip_sum = cksum_adjust(ipHdr->ip_sum, old, new_);
+    return 1;
+}
+
+/* El paquete que CoDel eligió: se marca si se puede, si no se descarta */
+static int sr_codel_signal(struct sr_codel* c, uint8_t* frame, unsigned int len)
+{
+    if (sr_codel_mark(frame, len))
+    {
+        c->marks++;
+        return SR_CODEL_MARK;
+    }
+    c->drops++;
+    return SR_CODEL_DROP;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_codel_dequeue
+ *
+ * Decide qué hacer con el paquete que sale de la cola: frame de len
+ * bytes, encolado en enq_ns, con backlog bytes detrás en la cola. Con
+ * SR_CODEL_DROP quien llama libera el paquete. Con frame NULL nunca se
+ * marca, sólo se descarta.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_codel_dequeue(struct sr_codel* c, uint8_t* frame, unsigned int len, uint64_t enq_ns,
+                     uint64_t now, unsigned int backlog)
+{
+    uint64_t sojourn = (now > enq_ns) ? now - enq_ns : 0;
+    int ok;
+
+    /* -- REQUIRES -- */
+    assert(c);
+
+    ok = sr_codel_ok_to_drop(c, sojourn, now, backlog);
+
+    if (c->dropping)
+    {
+        if (!ok)
+        {
+            c->dropping = 0;
+            return SR_CODEL_PASS;
+        }
+        if (now >= c->drop_next)
+        {
+            c->count++;
+            c->drop_next = sr_codel_control_law(c->drop_next, c->count);
+            return sr_codel_signal(c, frame, len);
+        }
+        return SR_CODEL_PASS;
+    }
+
+    if (ok)
+    {
+        /* Si se había salido hace poco del estado de descarte se retoma
+           cerca de la frecuencia que tenía */
+        c->dropping = 1;
+        if (c->count - c->lastcount > 1 && now - c->drop_next < 16 * SR_CODEL_INTERVAL)
+        {
+            c->count = c->count - c->lastcount;
+        }
+        else
+        {
+            c->count = 1;
+        }
+        c->lastcount = c->count;
+        c->drop_next = sr_codel_control_law(now, c->count);
+        return sr_codel_signal(c, frame, len);
+    }
+
+    return SR_CODEL_PASS;
+} /* -- sr_codel_dequeue -- */
@@ -0,0 +1,64 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_codel.h
+ *
+ * Descripción:
+ *
+ * Gestión activa de colas con CoDel (RFC 8289). CoDel no mira el largo
+ * de la cola sino cuánto esperó en ella cada paquete (sojourn): mientras
+ * la espera baje de SR_CODEL_TARGET en algún momento de cada intervalo
+ * de SR_CODEL_INTERVAL la cola es una ráfaga que se va a vaciar y no se
+ * toca. Si la espera queda por encima durante un intervalo entero hay una
+ * cola fija (bufferbloat) y se descarta un paquete; mientras siga así los
+ * descartes se hacen más frecuentes, cada INTERVAL / sqrt(n), hasta que
+ * la espera vuelva a bajar del objetivo.
+ *
+ * Un paquete IP que anuncia ECN (ECT) se marca con CE en lugar de
+ * descartarse, y se cuentan por separado descartes y marcas.
+ *
+ * Lo usan las colas de salida (sr_egress.h) y las listas de paquetes que
+ * esperan una respuesta ARP (sr_arpcache.h); cada cola tiene su
+ * struct sr_codel, protegida como el resto de la cola.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CODEL_H
+#define SR_CODEL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#define SR_CODEL_TARGET     5000000ULL      /* -- 5 ms, en ns -- */
+#define SR_CODEL_INTERVAL   100000000ULL    /* -- 100 ms, en ns -- */
+#define SR_CODEL_MAXPACKET  1514            /* -- con menos bytes en cola nunca se descarta -- */
+
+/* Qué hacer con el paquete que sale de la cola */
+enum sr_codel_verdict
+{
+    SR_CODEL_PASS,
+    SR_CODEL_MARK,              /* -- se marcó CE y sigue -- */
+    SR_CODEL_DROP
+};
+
+struct sr_codel
+{
+    uint64_t first_above;       /* -- cuándo vence el intervalo por encima del objetivo, 0 si no lo está -- */
+    uint64_t drop_next;         /* -- próximo descarte en estado de descarte -- */
+    uint32_t count;             /* -- descartes desde que se entró en ese estado -- */
+    uint32_t lastcount;
+    int dropping;
+
+    /* -- estadísticas -- */
+    unsigned long drops;
+    unsigned long marks;
+};
+
+uint64_t sr_codel_now(void);
+int sr_codel_dequeue(struct sr_codel*, uint8_t* frame, unsigned int len, uint64_t enq_ns,
+                     uint64_t now, unsigned int backlog);
+
+#endif /* -- SR_CODEL_H -- */
@@ -0,0 +1,186 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_counters.c
+ *
+ * Descripción:
+ *
+ * Contadores por hilo del plano de datos, ver sr_counters.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sr_counters.h"
+#include "sr_router.h"
+
+__thread struct sr_counters* sr_counters_self = 0;
+
+static struct sr_counters all_counters[SR_COUNTERS_MAX_THREADS];
+static int counters_used[SR_COUNTERS_MAX_THREADS];
+static unsigned int num_counters = 0;
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Lo contado por hilos que ya terminaron */
+static struct sr_counters retired;
+static pthread_key_t counters_key;
+static pthread_once_t counters_once = PTHREAD_ONCE_INIT;
+
+static const char* sr_drop_names[SR_DROP_COUNT] =
+{
+    "inválido",
+    "TTL vencido",
+    "sin ruta",
+    "ARP sin respuesta",
+    "broadcast",
+    "cola llena",
+    "cola lenta llena",
+    "MTU excedido con DF",
+    "cola de salida llena",
+    "CoDel",
+    "cola ARP llena"
+};
+
+static void sr_counters_add(struct sr_counters* total, const struct sr_counters* c)
+{
+    unsigned int j;
+
+    for (j = 0; j < SR_IF_MAX; j++)
+    {
+        total->ifs[j].rx_packets += c->ifs[j].rx_packets;
+        total->ifs[j].rx_bytes += c->ifs[j].rx_bytes;
+        total->ifs[j].tx_packets += c->ifs[j].tx_packets;
+        total->ifs[j].tx_bytes += c->ifs[j].tx_bytes;
+    }
+    total->forwarded += c->forwarded;
+    for (j = 0; j < SR_DROP_COUNT; j++)
+    {
+        total->drops[j] += c->drops[j];
+    }
+}
+
+/* Al terminar un hilo (PWOSPF lanza uno por cada hello y LSU enviado)
+   su bloque se suma a retired y queda libre para otro hilo */
+static void sr_counters_release(void* arg)
+{
+    struct sr_counters* c = arg;
+
+    pthread_mutex_lock(&counters_lock);
+    sr_counters_add(&retired, c);
+    memset(c, 0, sizeof(*c));
+    counters_used[c - all_counters] = 0;
+    pthread_mutex_unlock(&counters_lock);
+}
+
+static void sr_counters_key_init(void)
+{
+    pthread_key_create(&counters_key, sr_counters_release);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_register
+ *
+ * Asigna al hilo actual un bloque de contadores libre
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_counters* sr_counters_register(void)
+{
+    unsigned int i;
+
+    if (sr_counters_self == 0)
+    {
+        pthread_once(&counters_once, sr_counters_key_init);
+
+        pthread_mutex_lock(&counters_lock);
+        i = 0;
+        while (i < num_counters && counters_used[i])
+        {
+            i++;
+        }
+        assert(i < SR_COUNTERS_MAX_THREADS);
+        counters_used[i] = 1;
+        sr_counters_self = &all_counters[i];
+        if (i == num_counters)
+        {
+            __atomic_store_n(&num_counters, num_counters + 1, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&counters_lock);
+
+        pthread_setspecific(counters_key, sr_counters_self);
+    }
+    return sr_counters_self;
+} /* -- sr_counters_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_sum
+ *
+ * Suma en total los contadores de todos los hilos
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_sum(struct sr_counters* total)
+{
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(total);
+
+    memset(total, 0, sizeof(*total));
+
+    /* Con el lock ningún bloque pasa a retired mientras se suma */
+    pthread_mutex_lock(&counters_lock);
+    sr_counters_add(total, &retired);
+    for (i = 0; i < num_counters; i++)
+    {
+        sr_counters_add(total, &all_counters[i]);
+    }
+    pthread_mutex_unlock(&counters_lock);
+} /* -- sr_counters_sum -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_print
+ *
+ * Imprime los contadores de cada interfaz y los descartes por motivo
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_counters_print(struct sr_instance* sr)
+{
+    struct sr_counters total;
+    struct sr_if* iface;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    sr_counters_sum(&total);
+
+    printf("Interfaz   paq rx      bytes rx      paq tx      bytes tx\n");
+    for (i = 0; i < sr->num_ifs; i++)
+    {
+        iface = sr->if_table[i];
+        printf("%-8s %10lu %13lu %11lu %13lu\n", iface->name,
+               total.ifs[i].rx_packets, total.ifs[i].rx_bytes,
+               total.ifs[i].tx_packets, total.ifs[i].tx_bytes);
+    }
+
+    printf("Reenviados: %lu\n", total.forwarded);
+    for (i = 0; i < SR_DROP_COUNT; i++)
+    {
+        printf("Descartados (%s): %lu\n", sr_drop_names[i], total.drops[i]);
+    }
+} /* -- sr_counters_print -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_counters_drop_name
+ *
+ * Nombre de un motivo de descarte
+ *
+ *---------------------------------------------------------------------*/
+
+const char* sr_counters_drop_name(unsigned int reason)
+{
+    return (reason < SR_DROP_COUNT) ? sr_drop_names[reason] : "?";
+} /* -- sr_counters_drop_name -- */
@@ -0,0 +1,92 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_counters.h
+ *
+ * Descripción:
+ *
+ * Contadores del plano de datos: paquetes y bytes recibidos y enviados
+ * por interfaz, paquetes reenviados y descartes por motivo.
+ *
+ * Cada hilo incrementa su propio bloque de contadores, alineado a una
+ * línea de caché para que dos hilos nunca escriban en la misma línea, sin
+ * locks ni instrucciones atómicas; incrementar un contador cuesta lo
+ * mismo que incrementar una variable local. Los bloques de todos los
+ * hilos se suman sólo al leerlos (sr_counters_sum), por lo que una
+ * lectura concurrente puede quedar un paquete atrás de la realidad. El
+ * bloque de un hilo que termina se acumula aparte y queda libre para el
+ * próximo hilo.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_COUNTERS_H
+#define SR_COUNTERS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#include "sr_if.h"
+
+struct sr_instance;
+
+#define SR_COUNTERS_MAX_THREADS 64
+
+/* Motivos de descarte */
+enum sr_drop_reason
+{
+    SR_DROP_INVALID,            /* -- largo, suma de verificación o tipo inválidos -- */
+    SR_DROP_TTL,                /* -- TTL vencido -- */
+    SR_DROP_NO_ROUTE,           /* -- sin ruta al destino -- */
+    SR_DROP_ARP_FAIL,           /* -- el próximo salto no respondió ARP -- */
+    SR_DROP_BROADCAST,          /* -- broadcast de una subred conectada -- */
+    SR_DROP_QUEUE_FULL,         /* -- cola del trabajador llena -- */
+    SR_DROP_PUNT_FULL,          /* -- cola del camino lento llena -- */
+    SR_DROP_MTU,                /* -- mayor que el MTU de salida, con DF -- */
+    SR_DROP_EGRESS_FULL,        /* -- cola de salida llena -- */
+    SR_DROP_CODEL,              /* -- CoDel: esperó demasiado en una cola (sr_codel.h) -- */
+    SR_DROP_ARPQ_FULL,          /* -- demasiados paquetes esperando un ARP -- */
+    SR_DROP_COUNT
+};
+
+struct sr_if_counters
+{
+    unsigned long rx_packets;
+    unsigned long rx_bytes;
+    unsigned long tx_packets;
+    unsigned long tx_bytes;
+};
+
+struct sr_counters
+{
+    struct sr_if_counters ifs[SR_IF_MAX];
+    unsigned long forwarded;
+    unsigned long drops[SR_DROP_COUNT];
+} __attribute__((aligned(64)));
+
+extern __thread struct sr_counters* sr_counters_self;
+
+struct sr_counters* sr_counters_register(void);
+
+/* Bloque del hilo actual, que se registra en su primer uso */
+#define sr_counters() \
+    (sr_counters_self != 0 ? sr_counters_self : sr_counters_register())
+
+#define sr_count_rx(ifindex, bytes) \
+    do { struct sr_if_counters* c_ = &sr_counters()->ifs[ifindex]; \
+         c_->rx_packets++; c_->rx_bytes += (bytes); } while (0)
+
+#define sr_count_tx(ifindex, bytes) \
+    do { struct sr_if_counters* c_ = &sr_counters()->ifs[ifindex]; \
+         c_->tx_packets++; c_->tx_bytes += (bytes); } while (0)
+
+#define sr_count_forwarded(n)       (sr_counters()->forwarded += (n))
+#define sr_count_drop(reason)       (sr_counters()->drops[reason]++)
+
+void sr_counters_sum(struct sr_counters* total);
+void sr_counters_print(struct sr_instance*);
+const char* sr_counters_drop_name(unsigned int reason);
+
+#endif /* -- SR_COUNTERS_H -- */
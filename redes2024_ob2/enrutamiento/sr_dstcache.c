@@ -0,0 +1,122 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_dstcache.c
+ *
+ * Descripción:
+ *
+ * Caché de destinos por hilo, ver sr_dstcache.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sr_dstcache.h"
+#include "sr_fib.h"
+#include "sr_adj.h"
+
+#define SR_DSTCACHE_MAX_THREADS 64
+
+/* Contadores de un hilo; se suman al imprimirlos */
+struct sr_dstcache_stats
+{
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static __thread struct sr_dstcache_entry dstcache[SR_DSTCACHE_SIZE];
+static __thread struct sr_dstcache_stats* stats = 0;
+
+static struct sr_dstcache_stats all_stats[SR_DSTCACHE_MAX_THREADS];
+static unsigned int num_stats = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Índice de la entrada para un destino (hash multiplicativo) */
+static unsigned int sr_dstcache_index(uint32_t dst)
+{
+    return (dst * 2654435761U) >> (32 - SR_DSTCACHE_BITS);
+}
+
+static struct sr_dstcache_stats* sr_dstcache_thread_stats(void)
+{
+    if (stats == 0)
+    {
+        pthread_mutex_lock(&stats_lock);
+        assert(num_stats < SR_DSTCACHE_MAX_THREADS);
+        stats = &all_stats[num_stats++];
+        pthread_mutex_unlock(&stats_lock);
+    }
+    return stats;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_dstcache_lookup
+ *
+ * Devuelve la adyacencia guardada por el hilo para dst si la entrada
+ * sigue valiendo para la FIB publicada fib y la adyacencia no se
+ * retiró, o NULL.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_adj* sr_dstcache_lookup(struct sr_fib* fib, uint32_t dst)
+{
+    struct sr_dstcache_entry* entry = &dstcache[sr_dstcache_index(dst)];
+    struct sr_dstcache_stats* counters = sr_dstcache_thread_stats();
+
+    if (entry->adj != NULL && entry->dst == dst && entry->fib_gen == fib->generation &&
+        __atomic_load_n(&entry->adj->gen, __ATOMIC_ACQUIRE) == entry->adj_gen)
+    {
+        counters->hits++;
+        return entry->adj;
+    }
+
+    counters->misses++;
+    return NULL;
+} /* -- sr_dstcache_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_dstcache_fill
+ *
+ * Guarda la adyacencia que la FIB fib resolvió para dst, salvo que ya
+ * se haya retirado
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_dstcache_fill(struct sr_fib* fib, uint32_t dst, struct sr_adj* adj)
+{
+    struct sr_dstcache_entry* entry = &dstcache[sr_dstcache_index(dst)];
+
+    /* La generación se lee antes: si se retira después, cambia */
+    entry->adj_gen = __atomic_load_n(&adj->gen, __ATOMIC_ACQUIRE);
+    if (!__atomic_load_n(&adj->linked, __ATOMIC_RELAXED))
+    {
+        entry->adj = NULL;
+        return;
+    }
+    entry->dst = dst;
+    entry->adj = adj;
+    entry->fib_gen = fib->generation;
+} /* -- sr_dstcache_fill -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_dstcache_print_stats
+ *
+ * Imprime aciertos y fallos sumando los de todos los hilos
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_dstcache_print_stats(void)
+{
+    unsigned long hits = 0, misses = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i < num_stats; i++)
+    {
+        hits += all_stats[i].hits;
+        misses += all_stats[i].misses;
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    printf("Caché de destinos: %lu aciertos, %lu fallos\n", hits, misses);
+} /* -- sr_dstcache_print_stats -- */
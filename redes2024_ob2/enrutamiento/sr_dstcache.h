@@ -0,0 +1,49 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_dstcache.h
+ *
+ * Descripción:
+ *
+ * Caché de destinos delante de la FIB. Cada hilo tiene su propia tabla
+ * de correspondencia directa indexada por la IP destino; una entrada
+ * guarda la adyacencia (sr_adj.h) por la que sale el destino, de modo que
+ * un paquete en tránsito hacia un destino frecuente obtiene interfaz de
+ * salida y cabezal Ethernet con un solo acceso, sin la búsqueda del
+ * prefijo más largo.
+ *
+ * Las entradas recuerdan la versión de la FIB con la que se llenaron y
+ * dejan de valer cuando se publica otra, o cuando la adyacencia se
+ * retira de la tabla (su generación cambia). Los cambios de ARP no las
+ * afectan: se reflejan en la adyacencia.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_DSTCACHE_H
+#define SR_DSTCACHE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_adj;
+struct sr_fib;
+
+#define SR_DSTCACHE_BITS  8
+#define SR_DSTCACHE_SIZE  (1 << SR_DSTCACHE_BITS)
+
+struct sr_dstcache_entry
+{
+    uint32_t dst;                          /* -- IP destino (orden de red) -- */
+    struct sr_adj* adj;                    /* -- NULL si la entrada está vacía -- */
+    unsigned long fib_gen;
+    unsigned int adj_gen;
+};
+
+struct sr_adj* sr_dstcache_lookup(struct sr_fib*, uint32_t dst);
+void sr_dstcache_fill(struct sr_fib*, uint32_t dst, struct sr_adj* adj);
+void sr_dstcache_print_stats(void);
+
+#endif /* -- SR_DSTCACHE_H -- */
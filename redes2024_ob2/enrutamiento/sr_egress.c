@@ -0,0 +1,329 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_egress.c
+ *
+ * Descripción:
+ *
+ * Colas de salida por interfaz y su planificador DRR, ver sr_egress.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <netinet/in.h>
+
+#include "sr_egress.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pktbuf.h"
+#include "sr_counters.h"
+
+/* Vueltas sin trabajo antes de dormirse */
+#define SR_EGRESS_SPIN 1024
+
+static const char* sr_egress_class_names[SR_EGRESS_CLASSES] =
+{
+    "control",
+    "datos"
+};
+
+/* ARP y OSPF van a la cola de control */
+static unsigned int sr_egress_classify(const uint8_t* frame, unsigned int len)
+{
+    const sr_ethernet_hdr_t* eHdr = (const sr_ethernet_hdr_t*)frame;
+    const sr_ip_hdr_t* ipHdr = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    uint16_t type = ntohs(eHdr->ether_type);
+
+    if (type == ethertype_arp ||
+        (type == ethertype_ip && len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+         ipHdr->ip_p == ip_protocol_ospfv2))
+    {
+        return SR_EGRESS_CTRL;
+    }
+    return SR_EGRESS_DATA;
+}
+
+/* Duerme hasta que alguien encole una trama */
+static void sr_egress_wait(struct sr_egress* eg)
+{
+    struct sr_egress_queue* q;
+    unsigned int i, c, n;
+    int empty = 1;
+
+    pthread_mutex_lock(&(eg->lock));
+    __atomic_store_n(&eg->sleeping, 1, __ATOMIC_SEQ_CST);
+    for (;;)
+    {
+        n = __atomic_load_n(&eg->sr->num_ifs, __ATOMIC_ACQUIRE);
+        for (i = 0; i < n && empty; i++)
+        {
+            for (c = 0; c < SR_EGRESS_CLASSES && empty; c++)
+            {
+                q = &eg->port[i].q[c];
+                empty = (q->tail == __atomic_load_n(&q->head, __ATOMIC_SEQ_CST));
+            }
+        }
+        if (!empty)
+        {
+            break;
+        }
+        pthread_cond_wait(&(eg->cond), &(eg->lock));
+    }
+    __atomic_store_n(&eg->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&(eg->lock));
+}
+
+/* Turno DRR de una cola: envía lo que entre en su déficit, de a un
+   writev por tanda; devuelve las tramas sacadas de la cola. CoDel decide
+   por cada trama, y las que descarta no gastan déficit. */
+static unsigned int sr_egress_turn(struct sr_egress* eg, struct sr_egress_queue* q,
+                                   unsigned int ifindex)
+{
+    uint8_t* frames[SR_EGRESS_BATCH];
+    unsigned int lens[SR_EGRESS_BATCH];
+    struct sr_egress_item* item;
+    unsigned int head, tail, taken, n, i, bytes, done = 0;
+    uint64_t now, wait;
+
+    tail = q->tail;
+    head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (tail == head)
+    {
+        q->deficit = 0;
+        return 0;
+    }
+    q->deficit += SR_EGRESS_QUANTUM;
+
+    do
+    {
+        now = sr_codel_now();
+        bytes = __atomic_load_n(&q->bytes, __ATOMIC_RELAXED);
+        for (taken = n = 0; tail + taken != head && taken < SR_EGRESS_BATCH; taken++)
+        {
+            item = &q->ring[(tail + taken) & (SR_EGRESS_RING - 1)];
+            if (item->len > q->deficit)
+            {
+                break;
+            }
+            bytes -= item->len;
+            if (sr_codel_dequeue(&q->codel, sr_pktbuf_frame(item->pb), item->len,
+                                 item->enq_ns, now, bytes) == SR_CODEL_DROP)
+            {
+                sr_count_drop(SR_DROP_CODEL);
+                sr_pktbuf_put(item->pb);
+                item->pb = NULL;
+                continue;
+            }
+            q->deficit -= item->len;
+            frames[n] = sr_pktbuf_frame(item->pb);
+            lens[n] = item->len;
+            n++;
+        }
+        if (taken == 0)
+        {
+            break;
+        }
+
+        if (n > 0)
+        {
+            sr_write_frames(eg->sr, frames, lens, n, ifindex);
+        }
+
+        now = sr_codel_now();
+        for (i = 0; i < taken; i++, tail++)
+        {
+            item = &q->ring[tail & (SR_EGRESS_RING - 1)];
+            __atomic_sub_fetch(&q->bytes, item->len, __ATOMIC_RELAXED);
+            if (item->pb == NULL)
+            {
+                continue;
+            }
+            wait = now - item->enq_ns;
+            q->sojourn_sum += wait;
+            if (wait > q->sojourn_max)
+            {
+                q->sojourn_max = wait;
+            }
+            sr_pktbuf_put(item->pb);
+        }
+        __atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+        q->sent += n;
+        done += taken;
+    } while (taken == SR_EGRESS_BATCH);
+
+    /* Una cola que se vació no guarda déficit para la próxima vuelta */
+    if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+    {
+        q->deficit = 0;
+    }
+    return done;
+}
+
+static void* sr_egress_run(void* arg)
+{
+    struct sr_egress* eg = (struct sr_egress*)arg;
+    unsigned int i, c, n, done, spins = 0;
+
+    for (;;)
+    {
+        /* Una vuelta: cada interfaz, primero su cola de control */
+        done = 0;
+        n = __atomic_load_n(&eg->sr->num_ifs, __ATOMIC_ACQUIRE);
+        for (i = 0; i < n; i++)
+        {
+            for (c = 0; c < SR_EGRESS_CLASSES; c++)
+            {
+                done += sr_egress_turn(eg, &eg->port[i].q[c], i);
+            }
+        }
+
+        if (done > 0)
+        {
+            spins = 0;
+        }
+        else if (++spins >= SR_EGRESS_SPIN)
+        {
+            sr_egress_wait(eg);
+            spins = 0;
+        }
+    }
+
+    return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_start
+ *
+ * Crea las colas de salida, de hasta limit tramas cada una, y el hilo
+ * planificador; a partir de acá los envíos se encolan
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_start(struct sr_instance* sr, unsigned int limit)
+{
+    struct sr_egress* eg;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(limit > 0 && limit <= SR_EGRESS_RING);
+
+    eg = (struct sr_egress*)calloc(1, sizeof(struct sr_egress));
+    assert(eg);
+    eg->sr = sr;
+    eg->limit = limit;
+    pthread_mutex_init(&(eg->lock), NULL);
+    pthread_cond_init(&(eg->cond), NULL);
+    for (i = 0; i < SR_IF_MAX; i++)
+    {
+        pthread_mutex_init(&(eg->port[i].lock), NULL);
+    }
+
+    if (pthread_create(&(eg->thread), &(sr->attr), sr_egress_run, eg) != 0)
+    {
+        perror("pthread_create");
+        assert(0);
+    }
+
+    __atomic_store_n(&sr->egress, eg, __ATOMIC_RELEASE);
+} /* -- sr_egress_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_enqueue
+ *
+ * Encola la trama de pb, ya lista para salir por ifindex, en la cola de
+ * su clase. La cola se queda siempre con el buffer: con la cola llena
+ * lo devuelve al pool, cuenta el descarte y devuelve -1.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_egress_enqueue(struct sr_instance* sr, struct sr_pktbuf* pb, unsigned int len,
+                      unsigned int ifindex)
+{
+    struct sr_egress* eg = sr->egress;
+    struct sr_egress_port* port;
+    struct sr_egress_queue* q;
+    struct sr_egress_item* item;
+    unsigned int head, depth;
+
+    /* -- REQUIRES -- */
+    assert(eg);
+    assert(pb);
+    assert(ifindex < SR_IF_MAX);
+
+    port = &eg->port[ifindex];
+    q = &port->q[sr_egress_classify(sr_pktbuf_frame(pb), len)];
+
+    pthread_mutex_lock(&(port->lock));
+    head = q->head;
+    depth = head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    if (depth >= eg->limit)
+    {
+        q->drops++;
+        pthread_mutex_unlock(&(port->lock));
+        sr_count_drop(SR_DROP_EGRESS_FULL);
+        sr_pktbuf_put(pb);
+        return -1;
+    }
+
+    item = &q->ring[head & (SR_EGRESS_RING - 1)];
+    item->pb = pb;
+    item->len = len;
+    item->enq_ns = sr_codel_now();
+    __atomic_add_fetch(&q->bytes, len, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_SEQ_CST);
+    q->enqueued++;
+    if (depth + 1 > q->max_depth)
+    {
+        q->max_depth = depth + 1;
+    }
+    pthread_mutex_unlock(&(port->lock));
+
+    if (__atomic_load_n(&eg->sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&(eg->lock));
+        pthread_cond_signal(&(eg->cond));
+        pthread_mutex_unlock(&(eg->lock));
+    }
+    return 0;
+} /* -- sr_egress_enqueue -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_print_stats
+ *
+ * Imprime por cada cola usada lo enviado y descartado, la profundidad
+ * actual y máxima y la espera media y máxima
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_print_stats(struct sr_instance* sr)
+{
+    struct sr_egress* eg = sr->egress;
+    struct sr_egress_queue* q;
+    unsigned int i, c;
+
+    if (eg == 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < sr->num_ifs; i++)
+    {
+        for (c = 0; c < SR_EGRESS_CLASSES; c++)
+        {
+            q = &eg->port[i].q[c];
+            if (q->enqueued == 0 && q->drops == 0)
+            {
+                continue;
+            }
+            printf("Salida %s, %s: %lu enviadas, %lu descartadas, en cola %u (máx %u), "
+                   "espera media %lu us (máx %lu us), CoDel %lu descartes, %lu marcas\n",
+                   sr->if_table[i]->name, sr_egress_class_names[c], q->sent, q->drops,
+                   q->head - q->tail, q->max_depth,
+                   (unsigned long)(q->sent ? q->sojourn_sum / q->sent / 1000 : 0),
+                   (unsigned long)(q->sojourn_max / 1000), q->codel.drops, q->codel.marks);
+        }
+    }
+} /* -- sr_egress_print_stats -- */
@@ -0,0 +1,122 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_egress.h
+ *
+ * Descripción:
+ *
+ * Colas de salida por interfaz. Sin ellas cada hilo que envía (el lector,
+ * los trabajadores, el camino lento, los hilos de hello y LSU de PWOSPF,
+ * el de ARP) escribe en el socket apenas tiene la trama, y con el socket
+ * saturado un hello espera igual que cualquier paquete en tránsito.
+ *
+ * Con colas de salida (opción -q) los envíos de sr_vns_comm.c encolan la
+ * trama y un único hilo planificador escribe en el socket. Cada interfaz
+ * tiene dos colas, una por clase:
+ *
+ *   control    ARP y OSPF
+ *   datos      todo lo demás
+ *
+ * El planificador las atiende por deficit round robin (DRR): en cada
+ * vuelta cada cola con tramas suma su quantum en bytes a su déficit y
+ * envía mientras la trama de adelante entre en él; una cola vacía pierde
+ * el déficit. Ninguna interfaz ni clase acapara el socket, y como la
+ * cola de control de cada interfaz tiene su propio turno los hellos y
+ * LSU salen en la próxima vuelta aunque el tránsito llene su cola. Lo
+ * enviado en un turno se escribe con un solo writev.
+ *
+ * La trama espera en un buffer del pool (sr_pktbuf.h). El reenvío, sea
+ * del lector, de los trabajadores o del camino lento, entrega a la cola
+ * el mismo buffer en que se leyó la trama, así que el límite de las
+ * colas de datos, sumado en todas las interfaces, debería caber en
+ * SR_PKTBUF_COUNT. Los demás envíos, poco frecuentes, copian la trama a
+ * un buffer del pool común. Con la cola llena la trama se descarta y se
+ * cuenta. Por cola se cuentan además la profundidad máxima y el tiempo
+ * de espera (sojourn) medio y máximo.
+ *
+ * El límite sólo acota la memoria: cada cola tiene además CoDel
+ * (sr_codel.h), que el planificador consulta por cada trama que saca y
+ * que descarta o marca con ECN las que esperaron demasiado, así una cola
+ * que no se vacía no suma latencia hasta llenarse.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EGRESS_H
+#define SR_EGRESS_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#include "sr_if.h"
+#include "sr_codel.h"
+
+struct sr_instance;
+struct sr_pktbuf;
+
+#define SR_EGRESS_RING      512     /* -- potencia de 2, largo máximo de una cola -- */
+#define SR_EGRESS_QUANTUM   (4 * 1514) /* -- bytes por vuelta de cada cola -- */
+#define SR_EGRESS_BATCH     32      /* -- tramas por writev -- */
+
+enum sr_egress_class
+{
+    SR_EGRESS_CTRL,             /* -- ARP y OSPF -- */
+    SR_EGRESS_DATA,
+    SR_EGRESS_CLASSES
+};
+
+struct sr_egress_item
+{
+    struct sr_pktbuf* pb;
+    unsigned int len;
+    uint64_t enq_ns;            /* -- CLOCK_MONOTONIC al encolar -- */
+};
+
+struct sr_egress_queue
+{
+    struct sr_egress_item ring[SR_EGRESS_RING];
+    unsigned int head;          /* -- la escriben los que envían, con el lock del puerto -- */
+    char pad_head[64 - sizeof(unsigned int)];
+    unsigned int tail;          /* -- la escribe el planificador -- */
+    char pad_tail[64 - sizeof(unsigned int)];
+    unsigned int deficit;       /* -- bytes, sólo el planificador -- */
+    unsigned int bytes;         /* -- bytes en cola, atómico -- */
+    struct sr_codel codel;      /* -- sólo el planificador -- */
+
+    /* -- estadísticas -- */
+    unsigned long enqueued;
+    unsigned long drops;
+    unsigned int max_depth;
+    unsigned long sent;
+    uint64_t sojourn_sum;       /* -- ns -- */
+    uint64_t sojourn_max;
+};
+
+/* Las colas de una interfaz */
+struct sr_egress_port
+{
+    pthread_mutex_t lock;       /* -- serializa a los que encolan -- */
+    struct sr_egress_queue q[SR_EGRESS_CLASSES];
+};
+
+struct sr_egress
+{
+    struct sr_instance* sr;
+    pthread_t thread;
+    unsigned int limit;         /* -- tramas por cola -- */
+    int sleeping;               /* -- esperando en cond con las colas vacías -- */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct sr_egress_port port[SR_IF_MAX];
+};
+
+void sr_egress_start(struct sr_instance*, unsigned int limit);
+int sr_egress_enqueue(struct sr_instance*, struct sr_pktbuf* pb, unsigned int len,
+                      unsigned int ifindex);
+void sr_egress_print_stats(struct sr_instance*);
+
+#endif /* -- SR_EGRESS_H -- */
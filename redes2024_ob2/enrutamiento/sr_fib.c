@@ -0,0 +1,866 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Descripción:
+ *
+ * Trie de camino comprimido para la búsqueda del prefijo más largo y
+ * tabla DIR-24-8 opcional que se actualiza con la diferencia entre el
+ * trie de la versión anterior y el nuevo. Cada FIB es una versión
+ * inmutable de la tabla de enrutamiento.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+/* Codificación de las entradas de la tabla DIR-24-8 */
+#define SR_FIB_EXT          0x80000000U
+#define SR_FIB_VALUE_MASK   0x01ffffffU
+#define SR_FIB_DEPTH(e)     (((e) >> 25) & 0x3f)
+#define SR_FIB_VALUE(e)     ((e) & SR_FIB_VALUE_MASK)
+#define SR_FIB_ENTRY(plen, value) ((((uint32_t)(plen)) << 25) | (value))
+
+/* Entrada de tbl24 */
+#define SR_FIB_TBL24(dir, index) \
+    ((dir)->tbl24[(index) >> SR_FIB_CHUNK_BITS][(index) & (SR_FIB_CHUNK_ENTRIES - 1)])
+
+static int sr_fib_update_dir24(struct sr_fib*, struct sr_fib*);
+static void sr_fib_dir24_free(struct sr_fib_dir24*);
+static void sr_fib_dir24_add(struct sr_fib_dir24*, uint32_t, uint8_t, uint32_t);
+static void sr_fib_dir24_del(struct sr_fib_dir24*, uint32_t, uint8_t, uint32_t, uint32_t);
+static uint32_t sr_fib_slot_alloc(struct sr_fib_dir24*);
+
+/* Trozo de tbl24 sin rutas, compartido por todas las tablas y nunca escrito */
+static uint32_t sr_fib_zero_chunk[SR_FIB_CHUNK_ENTRIES];
+
+/* Máscara en orden de host para un largo de prefijo */
+static uint32_t sr_fib_mask(uint8_t plen)
+{
+    return (plen == 0) ? 0 : (0xffffffffU << (32 - plen));
+}
+
+/* Bit 'pos' de la clave, contando desde el más significativo */
+static int sr_fib_bit(uint32_t key, uint8_t pos)
+{
+    return (key >> (31 - pos)) & 1;
+}
+
+/* Cantidad de bits iniciales en común entre dos claves, acotada por max */
+static uint8_t sr_fib_common_len(uint32_t a, uint32_t b, uint8_t max)
+{
+    uint32_t diff = a ^ b;
+    uint8_t common = (diff == 0) ? 32 : (uint8_t)__builtin_clz(diff);
+    return (common < max) ? common : max;
+}
+
+static struct sr_fib_node* sr_fib_new_node(struct sr_fib* fib, uint32_t prefix,
+                                           uint8_t plen, struct sr_rt* route)
+{
+    struct sr_fib_node* node = (struct sr_fib_node*)calloc(1, sizeof(struct sr_fib_node));
+    assert(node);
+    node->prefix = prefix & sr_fib_mask(plen);
+    node->plen = plen;
+    node->route = route;
+    fib->num_nodes++;
+    if (route != NULL)
+    {
+        fib->num_routes++;
+    }
+    return node;
+}
+
+/* Microsegundos transcurridos desde start */
+static unsigned long sr_fib_elapsed_usec(struct timeval* start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000000UL + now.tv_usec - start->tv_usec;
+}
+
+static void sr_fib_free_subtree(struct sr_fib_node* node)
+{
+    if (node == NULL)
+    {
+        return;
+    }
+    sr_fib_free_subtree(node->child[0]);
+    sr_fib_free_subtree(node->child[1]);
+    free(node);
+}
+
+/* Suma route al grupo ECMP de head si ambas las instaló el SPF
+   (admin_dst > 1) con la misma métrica y route tiene un próximo salto
+   distinto; si no, se descarta como antes. Las estáticas y las
+   conectadas repetidas nunca forman grupo. */
+static void sr_fib_ecmp_join(struct sr_fib* fib, struct sr_rt* head, struct sr_rt* route)
+{
+    struct sr_rt* member;
+
+    if (route->admin_dst <= 1 || route->admin_dst != head->admin_dst ||
+        head->nh_count >= SR_FIB_ECMP_MAX)
+    {
+        return;
+    }
+
+    for (member = head; ; member = member->nh_next)
+    {
+        if (member->gw.s_addr == route->gw.s_addr &&
+            strncmp(member->interface, route->interface, sr_IFACE_NAMELEN) == 0)
+        {
+            return;
+        }
+        if (member->nh_next == NULL)
+        {
+            break;
+        }
+    }
+
+    member->nh_next = route;
+    if (head->nh_count++ == 1)
+    {
+        fib->num_multipath++;
+    }
+}
+
+/* Agrega una ruta al trie. Si ya hay una ruta con el mismo prefijo se
+   conserva la primera, igual que la búsqueda lineal sobre la lista; una
+   ruta del SPF puede además sumarse a su grupo ECMP (sr_fib_ecmp_join). */
+static void sr_fib_insert(struct sr_fib* fib, struct sr_rt* route)
+{
+    struct sr_fib_node** link;
+    struct sr_fib_node* node;
+    struct sr_fib_node* split;
+    uint8_t plen, common;
+    uint32_t key;
+
+    plen = sr_fib_mask_len(route->mask.s_addr);
+    key = ntohl(route->dest.s_addr) & sr_fib_mask(plen);
+
+    link = &fib->root;
+    while ((node = *link) != NULL)
+    {
+        common = sr_fib_common_len(node->prefix, key, (node->plen < plen) ? node->plen : plen);
+
+        if (common < node->plen)
+        {
+            if (common == plen)
+            {
+                /* El nuevo prefijo es ancestro del nodo actual */
+                split = sr_fib_new_node(fib, key, plen, route);
+                split->child[sr_fib_bit(node->prefix, plen)] = node;
+            }
+            else
+            {
+                /* Los prefijos divergen en el bit 'common': nodo de bifurcación */
+                split = sr_fib_new_node(fib, key, common, NULL);
+                split->child[sr_fib_bit(key, common)] = sr_fib_new_node(fib, key, plen, route);
+                split->child[sr_fib_bit(node->prefix, common)] = node;
+            }
+            *link = split;
+            return;
+        }
+
+        if (node->plen == plen)
+        {
+            /* Mismo prefijo: se instala si el nodo era interno; si no, la
+               ruta se suma al grupo ECMP cuando tiene la misma métrica */
+            if (node->route == NULL)
+            {
+                node->route = route;
+                fib->num_routes++;
+            }
+            else
+            {
+                sr_fib_ecmp_join(fib, node->route, route);
+            }
+            return;
+        }
+
+        link = &node->child[sr_fib_bit(key, node->plen)];
+    }
+
+    *link = sr_fib_new_node(fib, key, plen, route);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_mask_len
+ *
+ * Largo de prefijo de una máscara (en orden de red)
+ *
+ *---------------------------------------------------------------------*/
+
+uint8_t sr_fib_mask_len(uint32_t mask_nbo)
+{
+    uint32_t inverted = ~ntohl(mask_nbo);
+    return (inverted == 0) ? 32 : (uint8_t)__builtin_clz(inverted);
+} /* -- sr_fib_mask_len -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build
+ *
+ * Construye una FIB nueva con una copia de cada entrada de la lista
+ * routing_table. Si use_dir24 no es 0 también tiene tabla DIR-24-8,
+ * derivada de la de prev si prev la tiene; si no hay memoria para ella
+ * la FIB queda sólo con el trie. prev debe liberarse antes que la nueva.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_build(struct sr_rt* routing_table, struct sr_fib* prev, int use_dir24)
+{
+    struct sr_fib* fib;
+    struct sr_rt* walker;
+    struct timeval start;
+    unsigned int i, count = 0;
+
+    gettimeofday(&start, NULL);
+
+    fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib));
+    assert(fib);
+
+    for (walker = routing_table; walker != NULL; walker = walker->next)
+    {
+        count++;
+    }
+
+    if (count > 0)
+    {
+        fib->routes = (struct sr_rt*)malloc(count * sizeof(struct sr_rt));
+        assert(fib->routes);
+    }
+    fib->routes_size = count;
+
+    /* Las copias se encadenan en el mismo orden que la lista original */
+    for (walker = routing_table, i = 0; walker != NULL; walker = walker->next, i++)
+    {
+        fib->routes[i] = *walker;
+        fib->routes[i].next = (i + 1 < count) ? &fib->routes[i + 1] : NULL;
+        fib->routes[i].nh_next = NULL;
+        fib->routes[i].nh_count = 1;
+        sr_fib_insert(fib, &fib->routes[i]);
+    }
+
+    if (use_dir24 && sr_fib_update_dir24(fib, prev) != 0)
+    {
+        fprintf(stderr, "FIB: sin memoria para DIR-24-8, se usa sólo el trie\n");
+    }
+
+    fib->build_usec = sr_fib_elapsed_usec(&start);
+    return fib;
+} /* -- sr_fib_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_free
+ *
+ * Libera una FIB. Ningún lector puede estar usándola.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_free(struct sr_fib* fib)
+{
+    if (fib == NULL)
+    {
+        return;
+    }
+
+    sr_fib_free_subtree(fib->root);
+    if (fib->dir24 != NULL)
+    {
+        sr_fib_dir24_free(fib->dir24);
+    }
+    free(fib->routes);
+    free(fib);
+} /* -- sr_fib_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup
+ *
+ * Devuelve la entrada con el prefijo más largo que contiene a ip_nbo,
+ * o NULL si ninguna coincide.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(struct sr_fib* fib, uint32_t ip_nbo)
+{
+    struct sr_fib_dir24* dir = fib->dir24;
+    struct sr_fib_node* node;
+    struct sr_rt* best = NULL;
+    uint32_t key = ntohl(ip_nbo);
+    uint32_t entry;
+
+    if (dir != NULL)
+    {
+        entry = SR_FIB_TBL24(dir, key >> 8);
+        if (entry & SR_FIB_EXT)
+        {
+            entry = dir->tbl8[SR_FIB_VALUE(entry)][key & 0xff];
+        }
+        return dir->slots[SR_FIB_VALUE(entry)];
+    }
+
+    node = fib->root;
+    while (node != NULL)
+    {
+        if (((node->prefix ^ key) & sr_fib_mask(node->plen)) != 0)
+        {
+            break;
+        }
+        if (node->route != NULL)
+        {
+            best = node->route;
+        }
+        if (node->plen == 32)
+        {
+            break;
+        }
+        node = node->child[sr_fib_bit(key, node->plen)];
+    }
+
+    return best;
+} /* -- sr_fib_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_select
+ *
+ * Elige, con el hash del flujo, uno de los próximos saltos de igual
+ * costo de la ruta que devolvió sr_fib_lookup
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_select(struct sr_rt* route, uint32_t flow_hash)
+{
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(route);
+
+    for (i = (route->nh_count > 1) ? flow_hash % route->nh_count : 0; i > 0; i--)
+    {
+        route = route->nh_next;
+    }
+    return route;
+} /* -- sr_fib_select -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_print_stats
+ *
+ * Imprime el tamaño del trie, el tiempo de construcción y, si está
+ * habilitada, la memoria de la tabla DIR-24-8 y lo que copió su última
+ * actualización, que es lo que se suma a la versión anterior mientras
+ * ésta espera el período de gracia.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_print_stats(struct sr_fib* fib)
+{
+    struct sr_fib_dir24* dir = fib->dir24;
+
+    printf("FIB: %u prefijos (%u con ECMP), trie de %u nodos (%lu KB), construida en %lu us\n",
+           fib->num_routes, fib->num_multipath, fib->num_nodes,
+           (unsigned long)fib->num_nodes * sizeof(struct sr_fib_node) / 1024, fib->build_usec);
+
+    if (dir != NULL)
+    {
+        printf("FIB: DIR-24-8 tbl24 %u/%u trozos (%lu KB), tbl8 %u bloques (%lu KB), slots %lu KB\n",
+               dir->chunks, SR_FIB_CHUNKS,
+               (unsigned long)dir->chunks * SR_FIB_CHUNK_ENTRIES * sizeof(uint32_t) / 1024,
+               dir->tbl8_used,
+               (unsigned long)dir->tbl8_used * SR_FIB_TBL8_ENTRIES * sizeof(uint32_t) / 1024,
+               (unsigned long)dir->slots_size * sizeof(struct sr_rt*) / 1024);
+        printf("FIB: DIR-24-8 actualizada en %lu us: %u prefijos nuevos, %u quitados, "
+               "%u trozos y %u bloques copiados (%lu KB)\n",
+               fib->dir24_usec, dir->prefixes_added, dir->prefixes_removed,
+               dir->chunks_copied, dir->blocks_copied,
+               ((unsigned long)dir->chunks_copied * SR_FIB_CHUNK_ENTRIES +
+                (unsigned long)dir->blocks_copied * SR_FIB_TBL8_ENTRIES) * sizeof(uint32_t) / 1024);
+    }
+} /* -- sr_fib_print_stats -- */
+
+/***********************************************************************************
+ * Tabla DIR-24-8
+ * *********************************************************************************/
+
+/* Anota memoria que dir deja de compartir con la versión que la reemplaza;
+   se libera junto con dir, tras el período de gracia */
+static void sr_fib_retire(struct sr_fib_dir24* dir, void* mem)
+{
+    if (dir->retired_count == dir->retired_size)
+    {
+        dir->retired_size = (dir->retired_size == 0) ? 64 : dir->retired_size * 2;
+        dir->retired = (void**)realloc(dir->retired, dir->retired_size * sizeof(void*));
+        assert(dir->retired);
+    }
+    dir->retired[dir->retired_count++] = mem;
+}
+
+/* Trozo de tbl24 de la entrada index listo para escribir. El primer
+   cambio de la versión al trozo lo copia. */
+static uint32_t* sr_fib_chunk_write(struct sr_fib_dir24* dir, uint32_t index)
+{
+    uint32_t c = index >> SR_FIB_CHUNK_BITS;
+    uint32_t* chunk;
+
+    if (!dir->chunk_own[c])
+    {
+        chunk = (uint32_t*)malloc(SR_FIB_CHUNK_ENTRIES * sizeof(uint32_t));
+        assert(chunk);
+        memcpy(chunk, dir->tbl24[c], SR_FIB_CHUNK_ENTRIES * sizeof(uint32_t));
+        if (dir->tbl24[c] == sr_fib_zero_chunk)
+        {
+            dir->chunks++;
+        }
+        else
+        {
+            sr_fib_retire(dir->prev, dir->tbl24[c]);
+        }
+        dir->tbl24[c] = chunk;
+        dir->chunk_own[c] = 1;
+        dir->chunks_copied++;
+    }
+    return dir->tbl24[c];
+}
+
+static void sr_fib_tbl24_set(struct sr_fib_dir24* dir, uint32_t index, uint32_t entry)
+{
+    if (SR_FIB_TBL24(dir, index) != entry)
+    {
+        sr_fib_chunk_write(dir, index)[index & (SR_FIB_CHUNK_ENTRIES - 1)] = entry;
+    }
+}
+
+/* Bloque tbl8 listo para escribir; el primer cambio de la versión lo copia */
+static uint32_t* sr_fib_tbl8_write(struct sr_fib_dir24* dir, uint32_t block)
+{
+    uint32_t* entries;
+
+    if (!dir->tbl8_own[block])
+    {
+        entries = (uint32_t*)malloc(SR_FIB_TBL8_ENTRIES * sizeof(uint32_t));
+        assert(entries);
+        memcpy(entries, dir->tbl8[block], SR_FIB_TBL8_ENTRIES * sizeof(uint32_t));
+        sr_fib_retire(dir->prev, dir->tbl8[block]);
+        dir->tbl8[block] = entries;
+        dir->tbl8_own[block] = 1;
+        dir->blocks_copied++;
+    }
+    return dir->tbl8[block];
+}
+
+/* Reserva un slot para un prefijo nuevo */
+static uint32_t sr_fib_slot_alloc(struct sr_fib_dir24* dir)
+{
+    if (dir->slots_free_count > 0)
+    {
+        return dir->slots_free[--dir->slots_free_count];
+    }
+
+    if (dir->slots_used == dir->slots_size)
+    {
+        dir->slots_size *= 2;
+        assert(dir->slots_size <= SR_FIB_VALUE_MASK + 1);
+        dir->slots = (struct sr_rt**)realloc(dir->slots, dir->slots_size * sizeof(struct sr_rt*));
+        dir->slots_free = (uint32_t*)realloc(dir->slots_free, dir->slots_size * sizeof(uint32_t));
+        assert(dir->slots && dir->slots_free);
+        memset(dir->slots + dir->slots_used, 0,
+               (dir->slots_size - dir->slots_used) * sizeof(struct sr_rt*));
+    }
+    return dir->slots_used++;
+}
+
+/* Reserva un bloque tbl8 con todas sus entradas en fill */
+static uint32_t sr_fib_tbl8_alloc(struct sr_fib_dir24* dir, uint32_t fill)
+{
+    uint32_t block, i, old_blocks;
+    uint32_t* entries;
+
+    if (dir->tbl8_free_count == 0)
+    {
+        old_blocks = dir->tbl8_blocks;
+        dir->tbl8_blocks = (old_blocks == 0) ? 64 : old_blocks * 2;
+        assert(dir->tbl8_blocks <= SR_FIB_VALUE_MASK + 1);
+        dir->tbl8 = (uint32_t**)realloc(dir->tbl8, dir->tbl8_blocks * sizeof(uint32_t*));
+        dir->tbl8_own = (uint8_t*)realloc(dir->tbl8_own, dir->tbl8_blocks);
+        dir->tbl8_free = (uint32_t*)realloc(dir->tbl8_free, dir->tbl8_blocks * sizeof(uint32_t));
+        assert(dir->tbl8 && dir->tbl8_own && dir->tbl8_free);
+
+        for (i = dir->tbl8_blocks; i > old_blocks; i--)
+        {
+            dir->tbl8[i - 1] = NULL;
+            dir->tbl8_own[i - 1] = 0;
+            dir->tbl8_free[dir->tbl8_free_count++] = i - 1;
+        }
+    }
+
+    block = dir->tbl8_free[--dir->tbl8_free_count];
+    entries = (uint32_t*)malloc(SR_FIB_TBL8_ENTRIES * sizeof(uint32_t));
+    assert(entries);
+    for (i = 0; i < SR_FIB_TBL8_ENTRIES; i++)
+    {
+        entries[i] = fill;
+    }
+    dir->tbl8[block] = entries;
+    dir->tbl8_own[block] = 1;
+    dir->tbl8_used++;
+    dir->blocks_copied++;
+    return block;
+}
+
+/* Si todas las entradas del bloque quedaron iguales, vuelve a tbl24 */
+static void sr_fib_tbl8_compact(struct sr_fib_dir24* dir, uint32_t index)
+{
+    uint32_t block = SR_FIB_VALUE(SR_FIB_TBL24(dir, index));
+    uint32_t* entries = dir->tbl8[block];
+    uint32_t i;
+
+    for (i = 1; i < SR_FIB_TBL8_ENTRIES; i++)
+    {
+        if (entries[i] != entries[0])
+        {
+            return;
+        }
+    }
+
+    sr_fib_tbl24_set(dir, index, entries[0]);
+    if (dir->tbl8_own[block])
+    {
+        free(entries);
+    }
+    else
+    {
+        sr_fib_retire(dir->prev, entries);
+    }
+    dir->tbl8[block] = NULL;
+    dir->tbl8_own[block] = 0;
+    dir->tbl8_free[dir->tbl8_free_count++] = block;
+    dir->tbl8_used--;
+}
+
+/* Llena el rango del prefijo donde no haya un prefijo más largo. Sólo
+   escribe, y por lo tanto copia, lo que cambia. */
+static void sr_fib_dir24_add(struct sr_fib_dir24* dir, uint32_t key, uint8_t plen, uint32_t slot)
+{
+    uint32_t entry = SR_FIB_ENTRY(plen, slot);
+    uint32_t index, last, i, first8, last8, cur;
+    uint32_t* entries;
+
+    index = key >> 8;
+    if (plen <= 24)
+    {
+        last = index + (1U << (24 - plen));
+        first8 = 0;
+        last8 = SR_FIB_TBL8_ENTRIES;
+    }
+    else
+    {
+        last = index + 1;
+        first8 = key & 0xff;
+        last8 = first8 + (1U << (32 - plen));
+
+        cur = SR_FIB_TBL24(dir, index);
+        if (!(cur & SR_FIB_EXT))
+        {
+            sr_fib_tbl24_set(dir, index, SR_FIB_EXT | sr_fib_tbl8_alloc(dir, cur));
+        }
+    }
+
+    for (; index < last; index++)
+    {
+        cur = SR_FIB_TBL24(dir, index);
+        if (cur & SR_FIB_EXT)
+        {
+            entries = dir->tbl8[SR_FIB_VALUE(cur)];
+            for (i = first8; i < last8; i++)
+            {
+                if (SR_FIB_DEPTH(entries[i]) <= plen && entries[i] != entry)
+                {
+                    entries = sr_fib_tbl8_write(dir, SR_FIB_VALUE(cur));
+                    entries[i] = entry;
+                }
+            }
+        }
+        else if (SR_FIB_DEPTH(cur) <= plen)
+        {
+            sr_fib_tbl24_set(dir, index, entry);
+        }
+    }
+}
+
+/* Reemplaza las entradas que llenó el prefijo por las de la ruta que lo cubre */
+static void sr_fib_dir24_del(struct sr_fib_dir24* dir, uint32_t key, uint8_t plen,
+                             uint32_t slot, uint32_t replacement)
+{
+    uint32_t index, last, i, first8, last8, cur;
+    uint32_t* entries;
+    int changed;
+
+    index = key >> 8;
+    if (plen <= 24)
+    {
+        last = index + (1U << (24 - plen));
+        first8 = 0;
+        last8 = SR_FIB_TBL8_ENTRIES;
+    }
+    else
+    {
+        last = index + 1;
+        first8 = key & 0xff;
+        last8 = first8 + (1U << (32 - plen));
+    }
+
+    for (; index < last; index++)
+    {
+        cur = SR_FIB_TBL24(dir, index);
+        if (cur & SR_FIB_EXT)
+        {
+            entries = dir->tbl8[SR_FIB_VALUE(cur)];
+            for (i = first8, changed = 0; i < last8; i++)
+            {
+                if (SR_FIB_VALUE(entries[i]) == slot)
+                {
+                    entries = sr_fib_tbl8_write(dir, SR_FIB_VALUE(cur));
+                    entries[i] = replacement;
+                    changed = 1;
+                }
+            }
+            if (changed)
+            {
+                sr_fib_tbl8_compact(dir, index);
+            }
+        }
+        else if (SR_FIB_VALUE(cur) == slot)
+        {
+            sr_fib_tbl24_set(dir, index, replacement);
+        }
+    }
+}
+
+/* Entrada de la ruta más larga del trie que cubre a prefix/plen sin ser él */
+static uint32_t sr_fib_cover(struct sr_fib_node* node, uint32_t prefix, uint8_t plen)
+{
+    uint32_t entry = 0;
+
+    while (node != NULL && node->plen < plen &&
+           ((node->prefix ^ prefix) & sr_fib_mask(node->plen)) == 0)
+    {
+        if (node->route != NULL)
+        {
+            entry = SR_FIB_ENTRY(node->plen, node->slot);
+        }
+        node = node->child[sr_fib_bit(prefix, node->plen)];
+    }
+    return entry;
+}
+
+/* Nodos con ruta del trie en preorden, que es el orden por prefijo y,
+   a igual prefijo, por largo */
+static void sr_fib_collect(struct sr_fib_node* node, struct sr_fib_node** out, unsigned int* n)
+{
+    if (node == NULL)
+    {
+        return;
+    }
+    if (node->route != NULL)
+    {
+        out[(*n)++] = node;
+    }
+    sr_fib_collect(node->child[0], out, n);
+    sr_fib_collect(node->child[1], out, n);
+}
+
+static int sr_fib_node_cmp(struct sr_fib_node* a, struct sr_fib_node* b)
+{
+    if (a->prefix != b->prefix)
+    {
+        return (a->prefix < b->prefix) ? -1 : 1;
+    }
+    return (int)a->plen - (int)b->plen;
+}
+
+/* Tabla nueva que comparte todo con old, o vacía si old es NULL */
+static struct sr_fib_dir24* sr_fib_dir24_derive(struct sr_fib_dir24* old)
+{
+    struct sr_fib_dir24* dir;
+    unsigned int i;
+
+    dir = (struct sr_fib_dir24*)calloc(1, sizeof(struct sr_fib_dir24));
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+
+    if (old == NULL)
+    {
+        for (i = 0; i < SR_FIB_CHUNKS; i++)
+        {
+            dir->tbl24[i] = sr_fib_zero_chunk;
+        }
+        dir->slots_size = 64;
+        dir->slots_used = 1;
+    }
+    else
+    {
+        memcpy(dir->tbl24, old->tbl24, sizeof(dir->tbl24));
+        dir->chunks = old->chunks;
+        dir->tbl8_blocks = old->tbl8_blocks;
+        dir->tbl8_used = old->tbl8_used;
+        dir->tbl8_free_count = old->tbl8_free_count;
+        dir->slots_size = old->slots_size;
+        dir->slots_used = old->slots_used;
+        dir->slots_free_count = old->slots_free_count;
+    }
+
+    dir->slots = (struct sr_rt**)calloc(dir->slots_size, sizeof(struct sr_rt*));
+    dir->slots_free = (uint32_t*)malloc(dir->slots_size * sizeof(uint32_t));
+    if (dir->tbl8_blocks > 0)
+    {
+        dir->tbl8 = (uint32_t**)malloc(dir->tbl8_blocks * sizeof(uint32_t*));
+        dir->tbl8_own = (uint8_t*)calloc(dir->tbl8_blocks, 1);
+        dir->tbl8_free = (uint32_t*)malloc(dir->tbl8_blocks * sizeof(uint32_t));
+    }
+    if (dir->slots == NULL || dir->slots_free == NULL ||
+        (dir->tbl8_blocks > 0 && (dir->tbl8 == NULL || dir->tbl8_own == NULL || dir->tbl8_free == NULL)))
+    {
+        free(dir->slots);
+        free(dir->slots_free);
+        free(dir->tbl8);
+        free(dir->tbl8_own);
+        free(dir->tbl8_free);
+        free(dir);
+        return NULL;
+    }
+
+    if (old != NULL)
+    {
+        memcpy(dir->slots_free, old->slots_free, old->slots_free_count * sizeof(uint32_t));
+        if (dir->tbl8_blocks > 0)
+        {
+            memcpy(dir->tbl8, old->tbl8, dir->tbl8_blocks * sizeof(uint32_t*));
+            memcpy(dir->tbl8_free, old->tbl8_free, old->tbl8_free_count * sizeof(uint32_t));
+        }
+    }
+    dir->prev = old;
+    return dir;
+}
+
+/* Actualiza la tabla DIR-24-8 de prev con la diferencia entre los dos
+   tries y la deja en fib. Devuelve 0 si pudo reservar la memoria. */
+static int sr_fib_update_dir24(struct sr_fib* fib, struct sr_fib* prev)
+{
+    struct sr_fib_dir24* old = (prev != NULL) ? prev->dir24 : NULL;
+    struct sr_fib_node* old_root = (old != NULL) ? prev->root : NULL;
+    struct sr_fib_dir24* dir;
+    struct sr_fib_node** olds;
+    struct sr_fib_node** news;
+    unsigned int i, j, num_old = 0, num_new = 0, removed = 0, added = 0;
+    struct timeval start;
+    int cmp;
+
+    gettimeofday(&start, NULL);
+
+    dir = sr_fib_dir24_derive(old);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    /* Se recorren los dos tries en orden: un prefijo presente en ambos
+       conserva su slot y no toca la tabla, uno nuevo recibe un slot y
+       uno que desapareció se anota para quitarlo */
+    olds = (struct sr_fib_node**)malloc((prev != NULL ? prev->num_routes : 0) *
+                                        sizeof(struct sr_fib_node*) + 1);
+    news = (struct sr_fib_node**)malloc(fib->num_routes * sizeof(struct sr_fib_node*) + 1);
+    assert(olds && news);
+    sr_fib_collect(old_root, olds, &num_old);
+    sr_fib_collect(fib->root, news, &num_new);
+
+    for (i = j = 0; i < num_old || j < num_new; )
+    {
+        cmp = (i == num_old) ? 1 : (j == num_new) ? -1 : sr_fib_node_cmp(olds[i], news[j]);
+        if (cmp < 0)
+        {
+            olds[removed++] = olds[i++];
+            continue;
+        }
+        if (cmp > 0)
+        {
+            news[j]->slot = sr_fib_slot_alloc(dir);
+            news[added++] = news[j];
+        }
+        else
+        {
+            news[j]->slot = olds[i++]->slot;
+        }
+        dir->slots[news[j]->slot] = news[j]->route;
+        j++;
+    }
+
+    /* Lo quitado primero: su rango pasa a la ruta que lo cubre en el trie
+       nuevo, que ya tiene slot aunque también sea nueva */
+    for (i = 0; i < removed; i++)
+    {
+        sr_fib_dir24_del(dir, olds[i]->prefix, olds[i]->plen, olds[i]->slot,
+                         sr_fib_cover(fib->root, olds[i]->prefix, olds[i]->plen));
+        dir->slots_free[dir->slots_free_count++] = olds[i]->slot;
+    }
+    for (i = 0; i < added; i++)
+    {
+        sr_fib_dir24_add(dir, news[i]->prefix, news[i]->plen, news[i]->slot);
+    }
+    dir->prefixes_removed = removed;
+    dir->prefixes_added = added;
+    free(olds);
+    free(news);
+
+    if (old != NULL)
+    {
+        old->superseded = 1;
+    }
+    dir->prev = NULL;
+    fib->dir24 = dir;
+    fib->dir24_usec = sr_fib_elapsed_usec(&start);
+    return 0;
+}
+
+/* Libera una tabla. Si otra versión se derivó de ella sólo libera lo que
+   esa versión dejó de compartir; si no, todos sus trozos y bloques. */
+static void sr_fib_dir24_free(struct sr_fib_dir24* dir)
+{
+    unsigned int i;
+
+    if (dir->superseded)
+    {
+        for (i = 0; i < dir->retired_count; i++)
+        {
+            free(dir->retired[i]);
+        }
+    }
+    else
+    {
+        for (i = 0; i < SR_FIB_CHUNKS; i++)
+        {
+            if (dir->tbl24[i] != sr_fib_zero_chunk)
+            {
+                free(dir->tbl24[i]);
+            }
+        }
+        for (i = 0; i < dir->tbl8_blocks; i++)
+        {
+            free(dir->tbl8[i]);
+        }
+    }
+
+    free(dir->retired);
+    free(dir->tbl8);
+    free(dir->tbl8_own);
+    free(dir->tbl8_free);
+    free(dir->slots);
+    free(dir->slots_free);
+    free(dir);
+}
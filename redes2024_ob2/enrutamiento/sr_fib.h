@@ -0,0 +1,151 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Descripción:
+ *
+ * Tabla de reenvío (FIB) indexada con un trie binario de camino comprimido
+ * (Patricia). La tabla de enrutamiento (sr->routing_table) sigue siendo la
+ * lista de struct sr_rt que modifica el plano de control; cada FIB es una
+ * versión inmutable construida a partir de esa lista, con su propia copia
+ * de las entradas. sr_publish_fib (sr_rt.c) la publica en sr->fib con un
+ * único store atómico y libera la anterior tras un período de gracia
+ * (sr_rcu.h), por lo que el reenvío nunca ve una tabla a medio armar.
+ *
+ * Cada nodo guarda un prefijo y su largo; los largos crecen estrictamente al
+ * descender, por lo que una búsqueda visita a lo sumo un nodo por largo de
+ * prefijo, sin importar la cantidad de rutas de la tabla. make bench mide
+ * las búsquedas en el trie y en la lista (sr_fib_bench.c).
+ *
+ * Las rutas que instala el SPF (admin_dst > 1) al mismo prefijo con la
+ * misma métrica forman un grupo de próximos saltos de igual costo (ECMP):
+ * la primera queda instalada en el trie, con la cantidad de miembros en
+ * nh_count, y las demás se encadenan por nh_next. sr_fib_select elige un
+ * miembro con un hash del flujo, de modo que los paquetes de un flujo
+ * salen siempre por el mismo camino. Entre rutas estáticas o conectadas
+ * repetidas vale la primera, como en la búsqueda lineal.
+ *
+ * Opcionalmente (use_dir24 en sr_fib_build) se construye además una tabla DIR-24-8:
+ * un arreglo de 2^24 entradas indexado por los primeros 24 bits del destino
+ * y bloques de 256 entradas para los prefijos más largos que /24. Con ella
+ * la mayoría de las búsquedas se resuelven con un acceso al arreglo, más
+ * el de su directorio de trozos (32 KB, que queda en caché). Ocupa 64 MB
+ * más 1 KB por bloque; sr_fib_print_stats informa la memoria de cada
+ * versión.
+ *
+ * La tabla DIR-24-8 no se rearma en cada versión: la nueva se deriva de la
+ * anterior aplicando sólo los prefijos que aparecieron o desaparecieron.
+ * El arreglo de 2^24 entradas está partido en trozos de 4096 y las
+ * versiones comparten los trozos y bloques que no cambian; el primer
+ * cambio a uno lo copia, y el original queda para la versión anterior
+ * hasta que se libera tras el período de gracia (copy-on-write). Cada
+ * prefijo conserva su slot de una versión a la siguiente. make bench mide
+ * las búsquedas, el armado desde cero y la derivación tras un 1% de
+ * cambios.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_rt;
+
+#define SR_FIB_ECMP_MAX   8       /* -- miembros por grupo de igual costo -- */
+#define SR_FIB_ECMP_SEED  0x5bd1e995U   /* -- semilla del hash de flujo para ECMP -- */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_node
+ *
+ * Nodo del trie. Los nodos sin ruta son nodos internos de bifurcación.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_node
+{
+    uint32_t prefix;              /* -- prefijo en orden de host -- */
+    uint8_t  plen;                /* -- largo del prefijo (0..32) -- */
+    struct sr_rt* route;          /* -- ruta instalada, NULL si es interno -- */
+    uint32_t slot;                /* -- slot DIR-24-8 del prefijo, si hay tabla -- */
+    struct sr_fib_node* child[2];
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_dir24
+ *
+ * Tabla DIR-24-8. Cada entrada de 32 bits codifica:
+ *   bit 31      -> la entrada de tbl24 apunta a un bloque de tbl8
+ *   bits 30..25 -> largo del prefijo que la llenó
+ *   bits 24..0  -> índice en slots (0 = sin ruta) o número de bloque tbl8
+ *
+ * tbl24 se guarda en trozos de SR_FIB_CHUNK_ENTRIES entradas y tbl8 como
+ * un arreglo de punteros a bloques, para que las versiones los compartan.
+ *
+ * -------------------------------------------------------------------------- */
+
+#define SR_FIB_DIR24_ENTRIES  (1 << 24)
+#define SR_FIB_CHUNK_BITS     12
+#define SR_FIB_CHUNK_ENTRIES  (1 << SR_FIB_CHUNK_BITS)    /* -- 16 KB por trozo -- */
+#define SR_FIB_CHUNKS         (SR_FIB_DIR24_ENTRIES >> SR_FIB_CHUNK_BITS)
+#define SR_FIB_TBL8_ENTRIES   256
+#define SR_FIB_NONE           0xffffffffU
+
+struct sr_fib_dir24
+{
+    uint32_t* tbl24[SR_FIB_CHUNKS];   /* -- primer nivel, por trozos -- */
+    uint8_t chunk_own[SR_FIB_CHUNKS]; /* -- trozo copiado por esta versión -- */
+    unsigned int chunks;              /* -- trozos con alguna ruta -- */
+    uint32_t** tbl8;                  /* -- bloque de cada número, NULL si está libre -- */
+    uint8_t* tbl8_own;                /* -- bloque copiado por esta versión -- */
+    uint32_t tbl8_blocks;             /* -- números de bloque reservados -- */
+    uint32_t tbl8_used;               /* -- bloques en uso -- */
+    uint32_t* tbl8_free;              /* -- números de bloque libres -- */
+    uint32_t tbl8_free_count;
+    struct sr_rt** slots;             /* -- ruta de cada slot en esta versión, slots[0] sin uso -- */
+    uint32_t slots_size;
+    uint32_t slots_used;              /* -- slots asignados alguna vez -- */
+    uint32_t* slots_free;             /* -- slots de prefijos que desaparecieron -- */
+    uint32_t slots_free_count;
+
+    /* -- la actualización que derivó esta versión de la anterior -- */
+    struct sr_fib_dir24* prev;        /* -- sólo mientras se actualiza -- */
+    unsigned int prefixes_added;
+    unsigned int prefixes_removed;
+    unsigned int chunks_copied;
+    unsigned int blocks_copied;
+
+    /* -- memoria que esta versión deja de compartir con la siguiente -- */
+    int superseded;
+    void** retired;
+    unsigned int retired_count;
+    unsigned int retired_size;
+};
+
+struct sr_fib
+{
+    struct sr_fib_node* root;
+    unsigned int num_nodes;
+    unsigned int num_routes;
+    unsigned int num_multipath;   /* -- prefijos con más de un próximo salto -- */
+    struct sr_fib_dir24* dir24;   /* -- NULL si sólo se usa el trie -- */
+    struct sr_rt* routes;         /* -- copia de la tabla, encadenada por next -- */
+    unsigned int routes_size;
+    unsigned long build_usec;     /* -- tiempo que llevó construirla -- */
+    unsigned long dir24_usec;     /* -- de ese tiempo, el de actualizar DIR-24-8 -- */
+    unsigned long generation;     /* -- número de versión, lo asigna sr_publish_fib -- */
+};
+
+struct sr_fib* sr_fib_build(struct sr_rt* routing_table, struct sr_fib* prev, int use_dir24);
+void sr_fib_free(struct sr_fib*);
+void sr_fib_print_stats(struct sr_fib*);
+struct sr_rt* sr_fib_lookup(struct sr_fib*, uint32_t ip_nbo);
+struct sr_rt* sr_fib_select(struct sr_rt* route, uint32_t flow_hash);
+uint8_t sr_fib_mask_len(uint32_t mask_nbo);
+
+#endif /* -- SR_FIB_H -- */
@@ -0,0 +1,250 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib_bench.c
+ *
+ * Descripción:
+ *
+ * Medición de la FIB (sr_fib.h), fuera del router: make bench. Para cada
+ * cantidad de prefijos pedida arma una tabla al azar, con una mezcla
+ * parecida a la de una tabla real (55% /24, 35% de /16 a /23, 5% de /8 a
+ * /15, 5% más largos que /24, y la ruta por defecto), y mide:
+ *
+ *   - el costo de una búsqueda en la lista, como la hacía el router antes
+ *     del trie, con pocas búsquedas porque crece con la tabla;
+ *   - el costo de una búsqueda en el trie y el tiempo de armarlo;
+ *   - lo mismo con la tabla DIR-24-8, y el tiempo de derivar una versión
+ *     nueva de ella después de cambiar el 1% de los prefijos.
+ *
+ * La mitad de las direcciones buscadas son al azar y la otra mitad caen
+ * dentro de algún prefijo de la tabla. La memoria la informa
+ * sr_fib_print_stats. Los números dependen de la máquina y de CFLAGS.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netinet/in.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+#define SR_BENCH_LOOKUPS  4000000  /* -- búsquedas en el trie por medición -- */
+#define SR_BENCH_LIST_NS  2e8      /* -- presupuesto de la lista, en ns por ronda -- */
+#define SR_BENCH_SEED     7
+#define SR_BENCH_CHANGE   100      /* -- se cambia una ruta de cada tantas -- */
+
+static double sr_bench_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint32_t sr_bench_random(void)
+{
+    return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+static uint8_t sr_bench_plen(void)
+{
+    int r = random() % 100;
+
+    if (r < 5)
+    {
+        return 8 + random() % 8;
+    }
+    if (r < 60)
+    {
+        return 24;
+    }
+    if (r < 95)
+    {
+        return 16 + random() % 8;
+    }
+    return 25 + random() % 8;
+}
+
+static void sr_bench_route(struct sr_rt* route, uint32_t prefix, uint8_t plen)
+{
+    uint32_t mask = (plen == 0) ? 0 : 0xffffffffU << (32 - plen);
+
+    memset(route, 0, sizeof(struct sr_rt));
+    route->dest.s_addr = htonl(prefix & mask);
+    route->mask.s_addr = htonl(mask);
+    route->gw.s_addr = sr_bench_random();
+    strcpy(route->interface, "eth1");
+}
+
+/* Tabla de n rutas encadenada por next; la primera es la ruta por defecto */
+static struct sr_rt* sr_bench_table(unsigned int n)
+{
+    struct sr_rt* table = (struct sr_rt*)calloc(n, sizeof(struct sr_rt));
+    unsigned int i;
+
+    if (table == NULL)
+    {
+        perror("calloc");
+        exit(1);
+    }
+
+    sr_bench_route(&table[0], 0, 0);
+    for (i = 1; i < n; i++)
+    {
+        sr_bench_route(&table[i], sr_bench_random(), sr_bench_plen());
+        table[i - 1].next = &table[i];
+    }
+    return table;
+}
+
+/* Direcciones a buscar, en orden de red */
+static uint32_t* sr_bench_queries(struct sr_rt* table, unsigned int n)
+{
+    uint32_t* queries = (uint32_t*)malloc(SR_BENCH_LOOKUPS * sizeof(uint32_t));
+    struct sr_rt* route;
+    unsigned int i;
+
+    if (queries == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (i = 0; i < SR_BENCH_LOOKUPS; i++)
+    {
+        route = &table[random() % n];
+        if (i % 2)
+        {
+            queries[i] = htonl(sr_bench_random());
+        }
+        else
+        {
+            queries[i] = route->dest.s_addr | (htonl(sr_bench_random()) & ~route->mask.s_addr);
+        }
+    }
+    return queries;
+}
+
+/* La búsqueda lineal que el trie reemplazó */
+static struct sr_rt* sr_bench_list_lookup(struct sr_rt* table, uint32_t ip)
+{
+    struct sr_rt* best = NULL;
+    struct sr_rt* route;
+
+    for (route = table; route != NULL; route = route->next)
+    {
+        if ((ip & route->mask.s_addr) == route->dest.s_addr &&
+            (best == NULL || ntohl(route->mask.s_addr) > ntohl(best->mask.s_addr)))
+        {
+            best = route;
+        }
+    }
+    return best;
+}
+
+/* Nanosegundos por búsqueda de las primeras count direcciones */
+static double sr_bench_lookups(struct sr_fib* fib, struct sr_rt* table,
+                               const uint32_t* queries, unsigned int count)
+{
+    volatile unsigned long sink = 0;
+    unsigned int i;
+    double start = sr_bench_now();
+
+    for (i = 0; i < count; i++)
+    {
+        if (fib != NULL)
+        {
+            sink += (unsigned long)sr_fib_lookup(fib, queries[i]);
+        }
+        else
+        {
+            sink += (unsigned long)sr_bench_list_lookup(table, queries[i]);
+        }
+    }
+    return (sr_bench_now() - start) * 1e9 / count;
+}
+
+static void sr_bench_run(unsigned int n)
+{
+    struct sr_rt* table;
+    uint32_t* queries;
+    struct sr_fib* fib;
+    struct sr_fib* next;
+    unsigned int i, list_count;
+    double start, ns;
+
+    srandom(SR_BENCH_SEED);
+    table = sr_bench_table(n);
+    queries = sr_bench_queries(table, n);
+
+    list_count = (unsigned int)(SR_BENCH_LIST_NS / n / 3);
+    if (list_count == 0)
+    {
+        list_count = 1;
+    }
+    if (list_count > SR_BENCH_LOOKUPS)
+    {
+        list_count = SR_BENCH_LOOKUPS;
+    }
+    ns = sr_bench_lookups(NULL, table, queries, list_count);
+    printf("%u prefijos, lista: %.1f ns por búsqueda (%u búsquedas)\n", n, ns, list_count);
+
+    start = sr_bench_now();
+    fib = sr_fib_build(table, NULL, 0);
+    printf("%u prefijos, trie: armado en %.1f ms\n", n, (sr_bench_now() - start) * 1e3);
+    sr_bench_lookups(fib, NULL, queries, SR_BENCH_LOOKUPS);
+    ns = sr_bench_lookups(fib, NULL, queries, SR_BENCH_LOOKUPS);
+    printf("%u prefijos, trie: %.1f ns por búsqueda (%.2f M/s)\n", n, ns, 1e3 / ns);
+    sr_fib_print_stats(fib);
+    sr_fib_free(fib);
+
+    start = sr_bench_now();
+    fib = sr_fib_build(table, NULL, 1);
+    printf("%u prefijos, DIR-24-8: armado en %.1f ms\n", n, (sr_bench_now() - start) * 1e3);
+    sr_bench_lookups(fib, NULL, queries, SR_BENCH_LOOKUPS);
+    ns = sr_bench_lookups(fib, NULL, queries, SR_BENCH_LOOKUPS);
+    printf("%u prefijos, DIR-24-8: %.1f ns por búsqueda (%.2f M/s)\n", n, ns, 1e3 / ns);
+    sr_fib_print_stats(fib);
+
+    /* Versión derivada, como la que publica el SPF tras un cambio */
+    for (i = 1; i < n; i += SR_BENCH_CHANGE)
+    {
+        sr_bench_route(&table[i], sr_bench_random(), sr_bench_plen());
+        table[i].next = (i + 1 < n) ? &table[i + 1] : NULL;
+    }
+    start = sr_bench_now();
+    next = sr_fib_build(table, fib, 1);
+    printf("%u prefijos, DIR-24-8: derivada con el 1%% de cambios en %.1f ms\n",
+           n, (sr_bench_now() - start) * 1e3);
+    sr_fib_print_stats(next);
+    sr_fib_free(fib);
+    sr_fib_free(next);
+
+    free(queries);
+    free(table);
+}
+
+int main(int argc, char** argv)
+{
+    int i, n;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Format: %s prefijos [prefijos...]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        n = atoi(argv[i]);
+        if (n <= 0)
+        {
+            fprintf(stderr, "Invalid number of prefixes: %s\n", argv[i]);
+            return 1;
+        }
+        sr_bench_run(n);
+    }
+    return 0;
+}
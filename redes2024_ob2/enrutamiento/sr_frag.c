@@ -0,0 +1,134 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_frag.c
+ *
+ * Descripción:
+ *
+ * Fragmentación de datagramas IP con salida por piezas, ver sr_frag.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+#include "sr_frag.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_if.h"
+#include "sr_utils.h"
+#include "sr_log.h"
+
+#define SR_IP_HDR_MAX   60
+#define SR_IPOPT_EOL    0
+#define SR_IPOPT_NOP    1
+#define SR_IPOPT_COPY   0x80
+
+/* Copia en dst las opciones con el bit de copia, rellenas con EOL hasta
+   múltiplo de 4; devuelve su largo */
+static unsigned int sr_frag_copy_options(const uint8_t* opt, unsigned int len, uint8_t* dst)
+{
+    unsigned int i = 0, n = 0, olen;
+
+    while (i < len && opt[i] != SR_IPOPT_EOL)
+    {
+        if (opt[i] == SR_IPOPT_NOP)
+        {
+            i++;
+            continue;
+        }
+        if (i + 1 >= len || (olen = opt[i + 1]) < 2 || i + olen > len)
+        {
+            break;
+        }
+        if (opt[i] & SR_IPOPT_COPY)
+        {
+            memcpy(dst + n, opt + i, olen);
+            n += olen;
+        }
+        i += olen;
+    }
+
+    while (n % 4 != 0)
+    {
+        dst[n++] = SR_IPOPT_EOL;
+    }
+    return n;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip_fragment
+ *
+ * Envía por ifindex el datagrama de frame, que ya tiene armado el
+ * cabezal Ethernet, en fragmentos que entran en el MTU de la interfaz.
+ * No modifica frame. Devuelve la cantidad de fragmentos o -1 si falla.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ip_fragment(struct sr_instance* sr, uint8_t* frame, unsigned int len, unsigned int ifindex)
+{
+    uint8_t hdr[sizeof(sr_ethernet_hdr_t) + SR_IP_HDR_MAX];
+    uint8_t opts[SR_IP_HDR_MAX - sizeof(sr_ip_hdr_t)];
+    sr_ip_hdr_t* ipHdr = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    sr_ip_hdr_t* fragHdr = (sr_ip_hdr_t*)(hdr + sizeof(sr_ethernet_hdr_t));
+    struct iovec iov[2];
+    unsigned int mtu, hl, rest_hl, fhl, data_len, pos, chunk, max, off, flags;
+    int n = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(frame);
+    assert(ifindex < sr->num_ifs);
+
+    mtu = sr->if_table[ifindex]->mtu;
+    hl = ipHdr->ip_hl * 4;
+    data_len = ntohs(ipHdr->ip_len) - hl;
+    assert(sizeof(sr_ethernet_hdr_t) + hl + data_len <= len);
+
+    off = ntohs(ipHdr->ip_off);
+    flags = off & ~(IP_MF | IP_OFFMASK);
+    rest_hl = sizeof(sr_ip_hdr_t) +
+              sr_frag_copy_options((uint8_t*)(ipHdr + 1), hl - sizeof(sr_ip_hdr_t), opts);
+
+    memcpy(hdr, frame, sizeof(sr_ethernet_hdr_t));
+    for (pos = 0; pos < data_len; pos += chunk)
+    {
+        /* Los datos de cada fragmento salvo el último son múltiplo de 8 */
+        fhl = (pos == 0) ? hl : rest_hl;
+        max = (mtu - fhl) & ~7U;
+        if (max == 0)
+        {
+            return -1;
+        }
+        chunk = (data_len - pos < max) ? data_len - pos : max;
+
+        if (pos == 0)
+        {
+            memcpy(fragHdr, ipHdr, hl);
+        }
+        else
+        {
+            memcpy(fragHdr, ipHdr, sizeof(sr_ip_hdr_t));
+            memcpy(fragHdr + 1, opts, rest_hl - sizeof(sr_ip_hdr_t));
+        }
+        fragHdr->ip_hl = fhl / 4;
+        fragHdr->ip_len = htons(fhl + chunk);
+        fragHdr->ip_off = htons(flags | ((pos + chunk < data_len) ? IP_MF : (off & IP_MF)) |
+                                ((off & IP_OFFMASK) + pos / 8));
+        fragHdr->ip_sum = ip_cksum(fragHdr, fhl);
+
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = sizeof(sr_ethernet_hdr_t) + fhl;
+        iov[1].iov_base = (uint8_t*)ipHdr + hl + pos;
+        iov[1].iov_len = chunk;
+        if (sr_send_packetv(sr, iov, 2, ifindex) < 0)
+        {
+            return -1;
+        }
+        n++;
+    }
+
+    sr_log_event(IP, SR_LOG_DEBUG, SR_EV_FRAGMENT, ipHdr->ip_dst, n);
+    return n;
+} /* -- sr_ip_fragment -- */
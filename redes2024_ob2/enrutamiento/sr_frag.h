@@ -0,0 +1,38 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_frag.h
+ *
+ * Descripción:
+ *
+ * Fragmentación de datagramas IP (RFC 791). Cada interfaz tiene su MTU
+ * (sr_if.h, opción -m); un datagrama que no entra se envía en fragmentos
+ * si no tiene DF y, si lo tiene, se descarta y se avisa al origen con
+ * ICMP tipo 3 código 4 y el MTU en next_mtu.
+ *
+ * Los fragmentos no se copian: cada uno sale con sr_send_packetv como dos
+ * piezas, su cabezal Ethernet + IP armado en la pila y la porción de datos
+ * que le toca, leída del buffer del datagrama original. El primero lleva
+ * todas las opciones IP y los demás sólo las que tienen el bit de copia.
+ * Con colas de salida (sr_egress.h) cada fragmento tiene que esperar en
+ * un buffer propio y se copia al encolarlo.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FRAG_H
+#define SR_FRAG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_instance;
+
+/* El datagrama (cabezal IP en orden de red) no entra en la interfaz */
+#define sr_frag_needed(ipHdr, iface) (ntohs((ipHdr)->ip_len) > (iface)->mtu)
+
+int sr_ip_fragment(struct sr_instance*, uint8_t* frame, unsigned int len, unsigned int ifindex);
+
+#endif /* -- SR_FRAG_H -- */
@@ -0,0 +1,526 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_graph.c
+ *
+ * Descripción:
+ *
+ * Nodos del procesamiento por vectores, ver sr_graph.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <netinet/in.h>
+
+#include "sr_graph.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_utils.h"
+#include "sr_rcu.h"
+#include "sr_dstcache.h"
+#include "sr_counters.h"
+#include "sr_slowpath.h"
+#include "sr_pwospf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define SR_GRAPH_MAX_THREADS 64
+
+enum sr_graph_node
+{
+    SR_NODE_ETHERNET_INPUT,
+    SR_NODE_IP4_VALIDATE,
+    SR_NODE_IP4_LOOKUP,
+    SR_NODE_IP4_REWRITE,
+    SR_NODE_INTERFACE_OUTPUT,
+    SR_NODE_ARP_INPUT,
+    SR_NODE_OSPF_INPUT,
+    SR_NODE_IP4_SLOW,
+    SR_NODE_COUNT
+};
+
+static const char* sr_graph_node_names[SR_NODE_COUNT] =
+{
+    "ethernet-input",
+    "ip4-validate",
+    "ip4-lookup",
+    "ip4-rewrite",
+    "interface-output",
+    "arp-input",
+    "ospf-input",
+    "ip4-slow"
+};
+
+/* Índices, dentro del vector de tramas, de las que esperan en un nodo */
+struct sr_graph_vec
+{
+    unsigned int n;
+    uint16_t idx[SR_VEC_MAX];
+};
+
+/* Contadores de un nodo en un hilo; se suman al imprimirlos */
+struct sr_graph_node_stats
+{
+    unsigned long vectors;
+    unsigned long packets;
+    unsigned long long cycles;
+};
+
+struct sr_graph_stats
+{
+    struct sr_graph_node_stats node[SR_NODE_COUNT];
+};
+
+static __thread struct sr_graph_stats* stats = 0;
+
+static struct sr_graph_stats all_stats[SR_GRAPH_MAX_THREADS];
+static unsigned int num_stats = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct sr_graph_stats* sr_graph_thread_stats(void)
+{
+    if (stats == 0)
+    {
+        pthread_mutex_lock(&stats_lock);
+        assert(num_stats < SR_GRAPH_MAX_THREADS);
+        stats = &all_stats[num_stats++];
+        pthread_mutex_unlock(&stats_lock);
+    }
+    return stats;
+}
+
+/* Ciclos del procesador (TSC); en otras arquitecturas, nanosegundos */
+static uint64_t sr_graph_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void sr_graph_account(enum sr_graph_node node, unsigned int n, uint64_t start)
+{
+    struct sr_graph_node_stats* s = &sr_graph_thread_stats()->node[node];
+
+    s->vectors++;
+    s->packets += n;
+    s->cycles += sr_graph_now() - start;
+}
+
+static void sr_graph_enqueue(struct sr_graph_vec* vec, unsigned int i)
+{
+    vec->idx[vec->n++] = (uint16_t)i;
+}
+
+/* Con camino lento la trama se deriva junto con su buffer, o se descarta
+   si su cola está llena; devuelve 0 si hay que procesarla acá */
+static int sr_graph_punt(struct sr_instance* sr, struct sr_graph_pkt* p, unsigned int kind)
+{
+    if (sr->slowpath == NULL || p->pb == NULL)
+    {
+        return 0;
+    }
+
+    if (sr_slowpath_punt(sr, p->pb, p->len, p->ifindex, &p->meta, kind))
+    {
+        p->pb = NULL;
+    }
+    else
+    {
+        sr_count_drop(SR_DROP_PUNT_FULL);
+    }
+    return 1;
+}
+
+/* Adelanta los cabezales Ethernet e IP de la trama */
+static void sr_graph_prefetch(const struct sr_graph_pkt* p)
+{
+    __builtin_prefetch(p->frame);
+    __builtin_prefetch(p->frame + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+}
+
+/* Analiza cada trama y separa ARP de IP; descarta lo inválido */
+static void sr_graph_ethernet_input(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                                    unsigned int n, struct sr_graph_vec* arp,
+                                    struct sr_graph_vec* ip)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (i + 1 < n)
+        {
+            sr_graph_prefetch(&pkts[i + 1]);
+        }
+
+        if (!sr_parse_packet(sr, pkts[i].frame, pkts[i].len, &pkts[i].meta))
+        {
+            sr_count_drop(SR_DROP_INVALID);
+        }
+        else if (pkts[i].meta.ethertype == ethertype_ip)
+        {
+            sr_graph_enqueue(ip, i);
+        }
+        else
+        {
+            sr_graph_enqueue(arp, i);
+        }
+    }
+}
+
+static void sr_graph_ip4_validate(struct sr_graph_pkt* pkts,
+                                  const struct sr_graph_vec* in, struct sr_graph_vec* lookup,
+                                  struct sr_graph_vec* ospf, struct sr_graph_vec* slow)
+{
+    struct sr_graph_pkt* p;
+    sr_ip_hdr_t* ipHdr;
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        if (i + 1 < in->n)
+        {
+            sr_graph_prefetch(&pkts[in->idx[i + 1]]);
+        }
+
+        p = &pkts[in->idx[i]];
+        ipHdr = (sr_ip_hdr_t*)(p->frame + p->meta.l3_off);
+
+        if (p->meta.for_us && p->meta.proto == ip_protocol_ospfv2)
+        {
+            sr_graph_enqueue(ospf, in->idx[i]);
+        }
+        else if (p->meta.local == SR_LOCAL_BCAST)
+        {
+            /* El broadcast de una subred conectada no se reenvía */
+            sr_count_drop(SR_DROP_BROADCAST);
+            continue;
+        }
+        else if (p->meta.local == SR_LOCAL_IFACE || ipHdr->ip_ttl <= 1)
+        {
+            sr_graph_enqueue(slow, in->idx[i]);
+        }
+        else
+        {
+            sr_graph_enqueue(lookup, in->idx[i]);
+        }
+    }
+}
+
+/* Adyacencia de salida de cada trama, sin modificarla todavía */
+static void sr_graph_ip4_lookup(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                                const struct sr_graph_vec* in, struct sr_graph_vec* rewrite,
+                                struct sr_graph_vec* slow)
+{
+    struct sr_fib* fib = sr_rcu_dereference(sr->fib);
+    struct sr_graph_pkt* p;
+    sr_ip_hdr_t* ipHdr;
+    struct sr_rt* rt;
+    uint32_t dst;
+    int multipath;
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        if (i + 1 < in->n)
+        {
+            sr_graph_prefetch(&pkts[in->idx[i + 1]]);
+        }
+
+        p = &pkts[in->idx[i]];
+        ipHdr = (sr_ip_hdr_t*)(p->frame + sizeof(sr_ethernet_hdr_t));
+        dst = ipHdr->ip_dst;
+
+        p->adj = sr_dstcache_lookup(fib, dst);
+        if (p->adj == NULL)
+        {
+            rt = sr_fib_lookup(fib, dst);
+            if (rt == NULL)
+            {
+                sr_graph_enqueue(slow, in->idx[i]);
+                continue;
+            }
+
+            /* ECMP: el miembro sale del hash del flujo y no se cachea */
+            multipath = (rt->nh_count > 1);
+            if (multipath)
+            {
+                rt = sr_fib_select(rt, ip_flow_hash(ipHdr, p->len - sizeof(sr_ethernet_hdr_t),
+                                                    SR_FIB_ECMP_SEED));
+            }
+            if (rt->ifindex == SR_IFINDEX_NONE)
+            {
+                sr_graph_enqueue(slow, in->idx[i]);
+                continue;
+            }
+
+            p->adj = rt->adj;
+            if (p->adj == NULL && rt->gw.s_addr == 0)
+            {
+                p->adj = sr_adj_get(&(sr->adj), dst, sr_get_interface_by_index(sr, rt->ifindex));
+            }
+            if (p->adj == NULL)
+            {
+                sr_graph_enqueue(slow, in->idx[i]);
+                continue;
+            }
+            if (!multipath)
+            {
+                sr_dstcache_fill(fib, dst, p->adj);
+            }
+        }
+
+        /* Fragmentar, o avisar al origen si tiene DF, queda para ip4-slow */
+        if (p->meta.l3_len > sr->if_table[p->adj->ifindex]->mtu)
+        {
+            sr_graph_enqueue(slow, in->idx[i]);
+            continue;
+        }
+
+        sr_graph_enqueue(rewrite, in->idx[i]);
+    }
+}
+
+/* Cabezal Ethernet y TTL; sin vecino resuelto la trama sigue intacta
+   por ip4-slow, que la encola a la espera de ARP */
+static void sr_graph_ip4_rewrite(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                                 const struct sr_graph_vec* in, struct sr_graph_vec* output,
+                                 struct sr_graph_vec* slow)
+{
+    struct sr_graph_pkt* p;
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        if (i + 1 < in->n)
+        {
+            __builtin_prefetch(pkts[in->idx[i + 1]].adj);
+        }
+
+        p = &pkts[in->idx[i]];
+        if (!sr_adj_write_hdr(p->adj, p->frame) &&
+            !(sr_arpcache_fill_adj(sr, p->adj) && sr_adj_write_hdr(p->adj, p->frame)))
+        {
+            sr_graph_enqueue(slow, in->idx[i]);
+            continue;
+        }
+
+        ip_decrement_ttl((sr_ip_hdr_t*)(p->frame + sizeof(sr_ethernet_hdr_t)));
+        sr_graph_enqueue(output, in->idx[i]);
+    }
+}
+
+static void sr_graph_interface_output(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                                      const struct sr_graph_vec* in)
+{
+    struct sr_graph_pkt* p;
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        p = &pkts[in->idx[i]];
+
+        /* Con colas de salida la trama espera en su buffer, que se va con ella */
+        if (sr->egress != NULL && p->pb != NULL)
+        {
+            sr_send_pktbuf(sr, p->pb, p->len, p->adj->ifindex);
+            p->pb = NULL;
+        }
+        else
+        {
+            sr_send_packet_inplace(sr, p->frame, p->len, p->adj->ifindex);
+        }
+    }
+    sr_count_forwarded(in->n);
+}
+
+static void sr_graph_arp_input(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                               const struct sr_graph_vec* in)
+{
+    struct sr_graph_pkt* p;
+    sr_ethernet_hdr_t* eHdr;
+    uint8_t srcAddr[ETHER_ADDR_LEN], destAddr[ETHER_ADDR_LEN];
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        p = &pkts[in->idx[i]];
+        if (sr_graph_punt(sr, p, SR_PUNT_ARP))
+        {
+            continue;
+        }
+        eHdr = (sr_ethernet_hdr_t*)p->frame;
+        memcpy(destAddr, eHdr->ether_dhost, ETHER_ADDR_LEN);
+        memcpy(srcAddr, eHdr->ether_shost, ETHER_ADDR_LEN);
+        sr_handle_arp_packet(sr, p->frame, p->len, srcAddr, destAddr,
+                             sr->if_table[p->ifindex]->name, eHdr);
+    }
+}
+
+static void sr_graph_ospf_input(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                                const struct sr_graph_vec* in)
+{
+    struct sr_graph_pkt* p;
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        p = &pkts[in->idx[i]];
+        if (sr_graph_punt(sr, p, SR_PUNT_OSPF))
+        {
+            continue;
+        }
+        sr_handle_pwospf_packet(sr, p->frame, p->len, sr->if_table[p->ifindex]);
+    }
+}
+
+static void sr_graph_ip4_slow(struct sr_instance* sr, struct sr_graph_pkt* pkts,
+                              const struct sr_graph_vec* in)
+{
+    struct sr_graph_pkt* p;
+    sr_ethernet_hdr_t* eHdr;
+    uint8_t srcAddr[ETHER_ADDR_LEN], destAddr[ETHER_ADDR_LEN];
+    unsigned int i;
+
+    for (i = 0; i < in->n; i++)
+    {
+        p = &pkts[in->idx[i]];
+        if (sr_graph_punt(sr, p, SR_PUNT_IP))
+        {
+            continue;
+        }
+        eHdr = (sr_ethernet_hdr_t*)p->frame;
+        memcpy(destAddr, eHdr->ether_dhost, ETHER_ADDR_LEN);
+        memcpy(srcAddr, eHdr->ether_shost, ETHER_ADDR_LEN);
+        sr_handle_ip_packet(sr, p->frame, p->len, srcAddr, destAddr,
+                            sr->if_table[p->ifindex]->name, eHdr, &p->meta, &p->pb);
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_run
+ *
+ * Procesa las n tramas de pkts pasándolas nodo por nodo. Las tramas
+ * siguen siendo de quien llama, que puede liberarlas al volver.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_run(struct sr_instance* sr, struct sr_graph_pkt* pkts, unsigned int n)
+{
+    struct sr_graph_vec arp, ip, lookup, rewrite, output, ospf, slow;
+    uint64_t start;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(n <= SR_VEC_MAX);
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    arp.n = ip.n = lookup.n = rewrite.n = output.n = ospf.n = slow.n = 0;
+
+    sr_rcu_read_lock();
+
+    start = sr_graph_now();
+    sr_graph_ethernet_input(sr, pkts, n, &arp, &ip);
+    sr_graph_account(SR_NODE_ETHERNET_INPUT, n, start);
+
+    if (ip.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_ip4_validate(pkts, &ip, &lookup, &ospf, &slow);
+        sr_graph_account(SR_NODE_IP4_VALIDATE, ip.n, start);
+    }
+
+    if (lookup.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_ip4_lookup(sr, pkts, &lookup, &rewrite, &slow);
+        sr_graph_account(SR_NODE_IP4_LOOKUP, lookup.n, start);
+    }
+
+    if (rewrite.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_ip4_rewrite(sr, pkts, &rewrite, &output, &slow);
+        sr_graph_account(SR_NODE_IP4_REWRITE, rewrite.n, start);
+    }
+
+    if (output.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_interface_output(sr, pkts, &output);
+        sr_graph_account(SR_NODE_INTERFACE_OUTPUT, output.n, start);
+    }
+
+    if (arp.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_arp_input(sr, pkts, &arp);
+        sr_graph_account(SR_NODE_ARP_INPUT, arp.n, start);
+    }
+
+    if (ospf.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_ospf_input(sr, pkts, &ospf);
+        sr_graph_account(SR_NODE_OSPF_INPUT, ospf.n, start);
+    }
+
+    if (slow.n > 0)
+    {
+        start = sr_graph_now();
+        sr_graph_ip4_slow(sr, pkts, &slow);
+        sr_graph_account(SR_NODE_IP4_SLOW, slow.n, start);
+    }
+
+    sr_rcu_read_unlock();
+} /* -- sr_graph_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_graph_print_stats
+ *
+ * Imprime, por nodo y sumando todos los hilos, vectores procesados,
+ * paquetes por vector y ciclos por paquete
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_graph_print_stats(void)
+{
+    struct sr_graph_node_stats total;
+    unsigned int i, node;
+
+    printf("Nodo                  vectores   paq/vector  ciclos/paq\n");
+
+    pthread_mutex_lock(&stats_lock);
+    for (node = 0; node < SR_NODE_COUNT; node++)
+    {
+        total.vectors = total.packets = 0;
+        total.cycles = 0;
+        for (i = 0; i < num_stats; i++)
+        {
+            total.vectors += all_stats[i].node[node].vectors;
+            total.packets += all_stats[i].node[node].packets;
+            total.cycles += all_stats[i].node[node].cycles;
+        }
+
+        if (total.vectors > 0)
+        {
+            printf("%-20s %10lu %12.1f %11.1f\n", sr_graph_node_names[node], total.vectors,
+                   (double)total.packets / total.vectors, (double)total.cycles / total.packets);
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+} /* -- sr_graph_print_stats -- */
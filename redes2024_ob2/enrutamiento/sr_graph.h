@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_graph.h
+ *
+ * Descripción:
+ *
+ * Procesamiento de paquetes por vectores. En lugar de llevar cada trama
+ * de la recepción al envío, los trabajadores (sr_worker.h) pasan un
+ * vector de hasta SR_VEC_MAX tramas por una serie de nodos y cada nodo
+ * procesa todo el vector antes de pasar al siguiente, así su código y
+ * sus datos siguen en caché de un paquete al otro:
+ *
+ *   ethernet-input   analiza cada trama una sola vez (sr_parse.h) y
+ *                    separa ARP de IP
+ *   ip4-validate     aparta lo dirigido al router y descarta el
+ *                    broadcast de las subredes conectadas
+ *   ip4-lookup       caché de destinos o FIB: adyacencia de salida
+ *   ip4-rewrite      cabezal Ethernet armado y TTL
+ *   interface-output envía la trama desde su buffer
+ *   arp-input        sr_handle_arp_packet
+ *   ospf-input       sr_handle_pwospf_packet
+ *   ip4-slow         sr_handle_ip_packet, para todo lo que no es tránsito
+ *                    común: paquetes para el router, TTL vencido, sin
+ *                    ruta, vecino sin resolver o más grandes que el MTU
+ *                    de salida (sr_frag.h)
+ *
+ * Con camino lento (sr_slowpath.h) arp-input, ospf-input e ip4-slow no
+ * procesan las tramas sino que las derivan, con su buffer, a ese hilo.
+ *
+ * Cada nodo adelanta (prefetch) los cabezales del paquete siguiente y
+ * cuenta los ciclos que gasta, para ver por paquete dónde se va el tiempo.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_GRAPH_H
+#define SR_GRAPH_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#include "sr_parse.h"
+
+struct sr_instance;
+struct sr_adj;
+struct sr_pktbuf;
+
+#define SR_VEC_MAX 256
+
+/* Una trama del vector; ethernet-input completa meta e ip4-lookup adj */
+struct sr_graph_pkt
+{
+    uint8_t* frame;
+    unsigned int len;
+    unsigned int ifindex;       /* -- interfaz de llegada -- */
+    struct sr_pkt_meta meta;
+    struct sr_adj* adj;
+    struct sr_pktbuf* pb;       /* -- buffer de la trama, NULL si se derivó o no hay -- */
+};
+
+void sr_graph_run(struct sr_instance*, struct sr_graph_pkt* pkts, unsigned int n);
+void sr_graph_print_stats(void);
+
+#endif /* -- SR_GRAPH_H -- */
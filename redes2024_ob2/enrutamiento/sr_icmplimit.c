@@ -0,0 +1,165 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplimit.c
+ *
+ * Descripción:
+ *
+ * Baldes de fichas para los errores ICMP, ver sr_icmplimit.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include <netinet/in.h>
+
+#include "sr_icmplimit.h"
+
+#define SR_NSEC_PER_SEC 1000000000ULL
+
+static uint64_t sr_icmp_limit_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * SR_NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Acredita el tiempo transcurrido desde la última recarga */
+static void sr_tbucket_refill(struct sr_tbucket* b, uint64_t depth, uint64_t now)
+{
+    b->credit += now - b->last;
+    if (b->credit > depth)
+    {
+        b->credit = depth;
+    }
+    b->last = now;
+}
+
+static void sr_tbucket_fill(struct sr_tbucket* b, uint64_t depth, uint64_t now)
+{
+    b->credit = depth;
+    b->last = now;
+}
+
+static unsigned int sr_icmp_src_slot(uint32_t prefix)
+{
+    return (prefix * 2654435761U) >> 22 & (SR_ICMP_SRC_BUCKETS - 1);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_limit_init
+ *
+ * Configura las tasas, en errores por segundo (0 sin límite), y deja
+ * todos los baldes llenos
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_icmp_limit_init(struct sr_icmp_limit* lim, unsigned int global_rate,
+                        unsigned int iface_rate, unsigned int source_rate)
+{
+    unsigned int rates[SR_ICMP_TIER_COUNT];
+    uint64_t now = sr_icmp_limit_now();
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(lim);
+
+    memset(lim, 0, sizeof(*lim));
+    pthread_mutex_init(&(lim->lock), NULL);
+
+    rates[SR_ICMP_TIER_GLOBAL] = global_rate;
+    rates[SR_ICMP_TIER_IFACE] = iface_rate;
+    rates[SR_ICMP_TIER_SOURCE] = source_rate;
+    for (i = 0; i < SR_ICMP_TIER_COUNT; i++)
+    {
+        lim->cost[i] = (rates[i] > 0) ? SR_NSEC_PER_SEC / rates[i] : 0;
+        lim->depth[i] = lim->cost[i] * rates[i];
+    }
+
+    sr_tbucket_fill(&lim->global, lim->depth[SR_ICMP_TIER_GLOBAL], now);
+    for (i = 0; i < SR_IF_MAX; i++)
+    {
+        sr_tbucket_fill(&lim->ifs[i], lim->depth[SR_ICMP_TIER_IFACE], now);
+    }
+    for (i = 0; i < SR_ICMP_SRC_BUCKETS; i++)
+    {
+        lim->src[i].prefix = 0xffffffffU;
+    }
+} /* -- sr_icmp_limit_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_limit_allow
+ *
+ * Devuelve 1 y consume una ficha de cada nivel si el error ICMP que sale
+ * por ifindex hacia src_nbo puede enviarse; si no, lo cuenta como
+ * suprimido en el primer nivel sin fichas y devuelve 0
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmp_limit_allow(struct sr_icmp_limit* lim, unsigned int ifindex, uint32_t src_nbo)
+{
+    struct sr_tbucket* b[SR_ICMP_TIER_COUNT];
+    struct sr_icmp_src_bucket* s;
+    uint32_t prefix = ntohl(src_nbo) & (0xffffffffU << (32 - SR_ICMP_SRC_PLEN));
+    uint64_t now = sr_icmp_limit_now();
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(lim);
+    assert(ifindex < SR_IF_MAX);
+
+    pthread_mutex_lock(&(lim->lock));
+
+    s = &lim->src[sr_icmp_src_slot(prefix)];
+    if (s->prefix != prefix)
+    {
+        s->prefix = prefix;
+        sr_tbucket_fill(&s->b, lim->depth[SR_ICMP_TIER_SOURCE], now);
+    }
+
+    b[SR_ICMP_TIER_GLOBAL] = &lim->global;
+    b[SR_ICMP_TIER_IFACE] = &lim->ifs[ifindex];
+    b[SR_ICMP_TIER_SOURCE] = &s->b;
+
+    /* Se consume sólo si alcanza en los tres niveles */
+    for (i = 0; i < SR_ICMP_TIER_COUNT; i++)
+    {
+        if (lim->cost[i] == 0)
+        {
+            continue;
+        }
+        sr_tbucket_refill(b[i], lim->depth[i], now);
+        if (b[i]->credit < lim->cost[i])
+        {
+            lim->suppressed[i]++;
+            pthread_mutex_unlock(&(lim->lock));
+            return 0;
+        }
+    }
+    for (i = 0; i < SR_ICMP_TIER_COUNT; i++)
+    {
+        b[i]->credit -= lim->cost[i];
+    }
+    lim->sent++;
+
+    pthread_mutex_unlock(&(lim->lock));
+    return 1;
+} /* -- sr_icmp_limit_allow -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmp_limit_print_stats
+ *
+ * Imprime los errores enviados y los suprimidos por nivel
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_icmp_limit_print_stats(struct sr_icmp_limit* lim)
+{
+    pthread_mutex_lock(&(lim->lock));
+    printf("Errores ICMP: %lu enviados, suprimidos %lu (global) %lu (interfaz) %lu (origen)\n",
+           lim->sent, lim->suppressed[SR_ICMP_TIER_GLOBAL],
+           lim->suppressed[SR_ICMP_TIER_IFACE], lim->suppressed[SR_ICMP_TIER_SOURCE]);
+    pthread_mutex_unlock(&(lim->lock));
+} /* -- sr_icmp_limit_print_stats -- */
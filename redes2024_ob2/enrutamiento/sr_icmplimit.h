@@ -0,0 +1,83 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplimit.h
+ *
+ * Descripción:
+ *
+ * Límite de la tasa de errores ICMP. Antes de armar un error (TTL
+ * vencido, destino inalcanzable) sr_send_icmp_error_packet pide permiso a
+ * tres baldes de fichas (token buckets): uno global, uno por interfaz de
+ * salida y uno por prefijo /SR_ICMP_SRC_PLEN del destino del error, es
+ * decir del origen del paquete que lo provocó. El error se envía sólo si
+ * los tres tienen una ficha; si no se descarta sin reservar memoria, sin
+ * buscar la ruta del vecino y sin ARP, y se cuenta como suprimido.
+ *
+ * Cada balde se llena a rate fichas por segundo hasta un máximo de rate
+ * fichas (un segundo de ráfaga); rate 0 quiere decir sin límite. Los
+ * baldes por origen están en una tabla de acceso directo indexada por un
+ * hash del prefijo; un prefijo nuevo que cae en un lugar ocupado lo
+ * reemplaza con el balde lleno, de modo que la memoria es fija y el
+ * límite global sigue acotando a quien varíe el origen.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ICMPLIMIT_H
+#define SR_ICMPLIMIT_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#include "sr_if.h"
+
+#define SR_ICMP_LIMIT_GLOBAL    1000    /* -- errores por segundo, por omisión -- */
+#define SR_ICMP_LIMIT_IFACE     500
+#define SR_ICMP_LIMIT_SOURCE    50
+#define SR_ICMP_SRC_BUCKETS     1024    /* -- potencia de 2 -- */
+#define SR_ICMP_SRC_PLEN        24
+
+/* Niveles de límite, en el orden en que se consultan */
+enum sr_icmp_tier
+{
+    SR_ICMP_TIER_GLOBAL,
+    SR_ICMP_TIER_IFACE,
+    SR_ICMP_TIER_SOURCE,
+    SR_ICMP_TIER_COUNT
+};
+
+/* Crédito en nanosegundos: cada ficha vale cost ns */
+struct sr_tbucket
+{
+    uint64_t credit;
+    uint64_t last;              /* -- última recarga, ns -- */
+};
+
+struct sr_icmp_src_bucket
+{
+    uint32_t prefix;            /* -- orden de host -- */
+    struct sr_tbucket b;
+};
+
+struct sr_icmp_limit
+{
+    pthread_mutex_t lock;
+    uint64_t cost[SR_ICMP_TIER_COUNT];      /* -- ns por ficha, 0 sin límite -- */
+    uint64_t depth[SR_ICMP_TIER_COUNT];     /* -- crédito máximo -- */
+    struct sr_tbucket global;
+    struct sr_tbucket ifs[SR_IF_MAX];
+    struct sr_icmp_src_bucket src[SR_ICMP_SRC_BUCKETS];
+    unsigned long sent;
+    unsigned long suppressed[SR_ICMP_TIER_COUNT];
+};
+
+void sr_icmp_limit_init(struct sr_icmp_limit*, unsigned int global_rate,
+                        unsigned int iface_rate, unsigned int source_rate);
+int sr_icmp_limit_allow(struct sr_icmp_limit*, unsigned int ifindex, uint32_t src_nbo);
+void sr_icmp_limit_print_stats(struct sr_icmp_limit*);
+
+#endif /* -- SR_ICMPLIMIT_H -- */
@@ -24,91 +24,174 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_local.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_build_arp_req
+ * Scope: Local
+ *
+ * (Re)build the ARP request template of an interface from its MAC and IP
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_if_build_arp_req(struct sr_if* iface)
+{
+    sr_ethernet_hdr_t* eHdr = (sr_ethernet_hdr_t*)iface->arp_req;
+    sr_arp_hdr_t* arpHdr = (sr_arp_hdr_t*)(iface->arp_req + sizeof(sr_ethernet_hdr_t));
+
+    memset(eHdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    memcpy(eHdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    eHdr->ether_type = htons(ethertype_arp);
+
+    arpHdr->ar_hrd = htons(arp_hrd_ethernet);
+    arpHdr->ar_pro = htons(ethertype_ip);
+    arpHdr->ar_hln = ETHER_ADDR_LEN;
+    arpHdr->ar_pln = sizeof(uint32_t);
+    arpHdr->ar_op = htons(arp_op_request);
+    memcpy(arpHdr->ar_sha, iface->addr, ETHER_ADDR_LEN);
+    arpHdr->ar_sip = iface->ip;
+    memset(arpHdr->ar_tha, 0, ETHER_ADDR_LEN);
+    arpHdr->ar_tip = 0;
+} /* -- sr_if_build_arp_req -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_hash_name
+ * Scope: Local
+ *
+ * FNV-1a hash of an interface name, reduced to a slot of sr->if_hash
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_if_hash_name(const char* name)
+{
+    uint32_t h = 2166136261U;
+    int i;
+
+    for(i = 0; i < sr_IFACE_NAMELEN && name[i]; i++)
+    {
+        h ^= (uint8_t)name[i];
+        h *= 16777619U;
+    }
+
+    return h & (SR_IF_HASH - 1);
+} /* -- sr_if_hash_name -- */
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
  * Scope: Global
  *
  * Given an interface name return the interface record or 0 if it doesn't
- * exist.
+ * exist. Names are looked up in a hash table filled by sr_add_interface,
+ * hot paths should translate the name once and keep the ifindex.
  *
  *---------------------------------------------------------------------*/
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
 {
-    struct sr_if* if_walker = 0;
+    unsigned int slot = 0;
+    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
 
-    if_walker = sr->if_list;
-
-    while(if_walker)
+    /* -- open addressing, the table is never more than half full -- */
+    slot = sr_if_hash_name(name);
+    while(sr->if_hash[slot])
     {
-       if(!strncmp(if_walker->name,name,sr_IFACE_NAMELEN))
-        { return if_walker; }
-        if_walker = if_walker->next;
+        iface = sr->if_table[sr->if_hash[slot] - 1];
+        if(!strncmp(iface->name,name,sr_IFACE_NAMELEN))
+        { return iface; }
+        slot = (slot + 1) & (SR_IF_HASH - 1);
     }
 
     return 0;
 } /* -- sr_get_interface -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Given an ifindex return the interface record or 0 if it doesn't exist.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(ifindex >= sr->num_ifs)
+    { return 0; }
+
+    return sr->if_table[ifindex];
+} /* -- sr_get_interface_by_index -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface_given_ip
  * Scope: Global
  *
  * Given an interface IP address return the interface record or 0
- * if it doesn't exist.
+ * if it doesn't exist. Answered from the local address set, see
+ * sr_local.h.
  *
  *---------------------------------------------------------------------*/
 
 struct sr_if* sr_get_interface_given_ip(struct sr_instance* sr, uint32_t ip)
 {
-    struct sr_if* if_walker = 0;
+    unsigned int ifindex = 0;
 
     /* -- REQUIRES -- */
     assert(ip);
     assert(sr);
 
-    if_walker = sr->if_list;
-
-    while(if_walker)
-    {
-       if(if_walker->ip == ip)
-        { return if_walker; }
-        if_walker = if_walker->next;
-    }
+    if(sr_local_lookup(sr, ip, &ifindex) != SR_LOCAL_IFACE)
+    { return 0; }
 
-    return 0;
+    return sr_get_interface_by_index(sr, ifindex);
 } /* -- sr_get_interface_given_ip -- */
 
 /*---------------------------------------------------------------------
  * Method: sr_add_interface(..)
  * Scope: Global
  *
- * Add and interface to the router's list
+ * Add and interface to the router's list and give it the next ifindex
  *
  *---------------------------------------------------------------------*/
 
 void sr_add_interface(struct sr_instance* sr, const char* name)
 {
     struct sr_if* if_walker = 0;
+    struct sr_if* iface = 0;
+    unsigned int slot = 0;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
+    assert(sr->num_ifs < SR_IF_MAX);
+
+    iface = (struct sr_if*)malloc(sizeof(struct sr_if));
+    assert(iface);
+    iface->next = 0;
+    iface->neighbor_id = 0;
+    iface->neighbor_ip = 0;
+    iface->helloint = 0;
+    iface->mtu = SR_IF_MTU;
+    strncpy(iface->name,name,sr_IFACE_NAMELEN);
+
+    /* -- next dense index, and its slot in the name hash -- */
+    iface->ifindex = sr->num_ifs;
+    sr->if_table[sr->num_ifs++] = iface;
+
+    slot = sr_if_hash_name(iface->name);
+    while(sr->if_hash[slot])
+    { slot = (slot + 1) & (SR_IF_HASH - 1); }
+    sr->if_hash[slot] = iface->ifindex + 1;
 
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
-        sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
-        assert(sr->if_list);
-        sr->if_list->next = 0;
-        sr->if_list->neighbor_id = 0;
-        sr->if_list->neighbor_ip = 0;
-        sr->if_list->helloint = 0;
-        strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
+        sr->if_list = iface;
         return;
     }
 
@@ -117,14 +200,7 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     while(if_walker->next)
     {if_walker = if_walker->next; }
 
-    if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
-    assert(if_walker->next);
-    if_walker = if_walker->next;
-    if_walker->neighbor_id = 0;
-    if_walker->neighbor_ip = 0;
-    strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
-    if_walker->next = 0;
-    if_walker->helloint = 0;
+    if_walker->next = iface;
 } /* -- sr_add_interface -- */ 
 
 /*--------------------------------------------------------------------- 
@@ -148,6 +224,7 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
 
     /* -- copy address -- */
     memcpy(if_walker->addr,addr,6);
+    sr_if_build_arp_req(if_walker);
 
 } /* -- sr_set_ether_addr -- */
 
@@ -172,6 +249,8 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
+    sr_if_build_arp_req(if_walker);
+    sr_local_rebuild(sr);
 
 } /* -- sr_set_ether_ip -- */
 
@@ -196,9 +275,80 @@ void sr_set_ether_mask(struct sr_instance* sr, uint32_t mask_nbo)
 
     /* -- copy address -- */
     if_walker->mask = mask_nbo;
+    sr_local_rebuild(sr);
 
 } /* -- sr_set_ether_mask -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_interface_mtu(..)
+ * Scope: Global
+ *
+ * set the MTU of the named interface, returns -1 if there is no such
+ * interface or the MTU is out of range
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_set_interface_mtu(struct sr_instance* sr, const char* name, unsigned int mtu)
+{
+    struct sr_if* iface = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(name);
+
+    iface = sr_get_interface(sr, name);
+    if(iface == 0 || mtu < SR_IF_MTU_MIN || mtu > 0xffff)
+    { return -1; }
+
+    iface->mtu = mtu;
+    return 0;
+} /* -- sr_set_interface_mtu -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_interface_mtus(..)
+ * Scope: Global
+ *
+ * set MTUs from a list "iface:mtu[,iface:mtu...]" as given to -m, each
+ * bad entry is reported and skipped; returns -1 if there was any
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_set_interface_mtus(struct sr_instance* sr, const char* spec)
+{
+    char* copy = 0;
+    char* entry = 0;
+    char* save = 0;
+    char* sep = 0;
+    char* end = 0;
+    unsigned long mtu;
+    int ret = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(spec);
+
+    copy = strdup(spec);
+    assert(copy);
+
+    for(entry = strtok_r(copy, ",", &save); entry; entry = strtok_r(0, ",", &save))
+    {
+        sep = strchr(entry, ':');
+        if(sep != 0)
+        {
+            *sep = 0;
+            mtu = strtoul(sep + 1, &end, 10);
+        }
+        if(sep == 0 || *end != 0 || sr_set_interface_mtu(sr, entry, mtu) != 0)
+        {
+            fprintf(stderr, "** Error, bad MTU for interface %s\n", entry);
+            ret = -1;
+        }
+    }
+
+    free(copy);
+    return ret;
+} /* -- sr_set_interface_mtus -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_print_if_list(..)
  * Scope: Global
@@ -250,4 +400,5 @@ void sr_print_if(struct sr_if* iface)
     DebugMAC(iface->addr);
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
+    Debug("\tmtu %u\n",iface->mtu);
 } /* -- sr_print_if -- */
@@ -28,6 +28,12 @@
 
 struct sr_instance;
 
+#define SR_IF_MAX        32          /* interfaces per router */
+#define SR_IF_HASH       64          /* name hash slots, power of 2 > SR_IF_MAX */
+#define SR_IFINDEX_NONE  0xffffffffU /* no interface */
+#define SR_IF_MTU        1500        /* default MTU */
+#define SR_IF_MTU_MIN    68          /* smallest MTU allowed (RFC 791) */
+
 /* ----------------------------------------------------------------------------
  * struct sr_if
  *
@@ -41,6 +47,11 @@ struct sr_if
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
+  unsigned int ifindex;   /* position in sr->if_table, dense from 0 */
+  uint16_t mtu;           /* largest IP datagram sent, ethernet header excluded */
+  /* broadcast ARP request from this interface; the target IP, its last
+     field, is filled in when sending */
+  uint8_t arp_req[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
   struct sr_if* next;
 
   /**** New Fields ****/
@@ -52,11 +63,14 @@ struct sr_if
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int ifindex);
 struct sr_if* sr_get_interface_given_ip(struct sr_instance* sr, uint32_t ip);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
 void sr_set_ether_mask(struct sr_instance*, uint32_t mask_nbo);
+int sr_set_interface_mtu(struct sr_instance*, const char* name, unsigned int mtu);
+int sr_set_interface_mtus(struct sr_instance*, const char* spec);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
 
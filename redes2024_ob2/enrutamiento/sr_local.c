@@ -0,0 +1,132 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_local.c
+ *
+ * Descripción:
+ *
+ * Conjunto de direcciones locales del router, ver sr_local.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+
+#include <netinet/in.h>
+
+#include "sr_local.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "pwospf_protocol.h"
+
+static unsigned int sr_local_slot(uint32_t ip)
+{
+    return (ip * 2654435761U) >> (32 - SR_LOCAL_HASH_BITS);
+}
+
+/* Agrega ip si no está; la primera clase registrada para una dirección
+   es la que queda */
+static void sr_local_add(struct sr_local_table* table, uint32_t ip, unsigned int ifindex,
+                         uint8_t kind)
+{
+    unsigned int slot = sr_local_slot(ip);
+
+    if (ip == 0)
+    {
+        return;
+    }
+
+    while (table->slots[slot].kind != SR_LOCAL_NONE)
+    {
+        if (table->slots[slot].ip == ip)
+        {
+            return;
+        }
+        slot = (slot + 1) & (SR_LOCAL_HASH - 1);
+    }
+
+    assert(table->count < SR_LOCAL_HASH / 2);
+    table->slots[slot].ip = ip;
+    table->slots[slot].ifindex = ifindex;
+    table->slots[slot].kind = kind;
+    table->count++;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_local_rebuild
+ *
+ * Vuelve a armar el conjunto a partir de la lista de interfaces. Las IP
+ * de las interfaces se agregan primero, así una dirección que sea a la
+ * vez IP de interfaz y broadcast de otra subred cuenta como IP propia.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_local_rebuild(struct sr_instance* sr)
+{
+    struct sr_local_table* table;
+    struct sr_if* iface;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    table = &sr->local;
+    __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memset(table->slots, 0, sizeof(table->slots));
+    table->count = 0;
+
+    for (iface = sr->if_list; iface != NULL; iface = iface->next)
+    {
+        sr_local_add(table, iface->ip, iface->ifindex, SR_LOCAL_IFACE);
+    }
+    for (iface = sr->if_list; iface != NULL; iface = iface->next)
+    {
+        /* Sin máscara todavía (o /32) no hay broadcast de subred */
+        if (iface->ip != 0 && iface->mask != 0 && iface->mask != 0xffffffffU)
+        {
+            sr_local_add(table, iface->ip | ~iface->mask, iface->ifindex, SR_LOCAL_BCAST);
+        }
+    }
+    sr_local_add(table, htonl(OSPF_AllSPFRouters), 0, SR_LOCAL_MCAST);
+
+    __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELEASE);
+} /* -- sr_local_rebuild -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_local_lookup
+ *
+ * Devuelve la clase de ip (SR_LOCAL_NONE si no es una dirección local)
+ * y, si ifindex no es NULL, la interfaz a la que pertenece
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_local_lookup(struct sr_instance* sr, uint32_t ip_nbo, unsigned int* ifindex)
+{
+    const struct sr_local_table* table = &sr->local;
+    unsigned int seq, slot, index;
+    int kind;
+
+    do
+    {
+        seq = __atomic_load_n(&table->seq, __ATOMIC_ACQUIRE);
+        kind = SR_LOCAL_NONE;
+        index = SR_IFINDEX_NONE;
+
+        for (slot = sr_local_slot(ip_nbo); table->slots[slot].kind != SR_LOCAL_NONE;
+             slot = (slot + 1) & (SR_LOCAL_HASH - 1))
+        {
+            if (table->slots[slot].ip == ip_nbo)
+            {
+                kind = table->slots[slot].kind;
+                index = table->slots[slot].ifindex;
+                break;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&table->seq, __ATOMIC_RELAXED));
+
+    if (ifindex != NULL)
+    {
+        *ifindex = index;
+    }
+    return kind;
+} /* -- sr_local_lookup -- */
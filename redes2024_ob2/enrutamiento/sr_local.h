@@ -0,0 +1,59 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_local.h
+ *
+ * Descripción:
+ *
+ * Conjunto de direcciones locales del router: las IP de sus interfaces,
+ * el broadcast de cada subred conectada y AllSPFRouters (224.0.0.5). Es
+ * una tabla hash de direccionamiento abierto que nunca pasa de la mitad
+ * de su capacidad, así que clasificar el destino de un paquete cuesta un
+ * par de accesos en lugar de recorrer la lista de interfaces.
+ *
+ * La tabla se reconstruye entera cada vez que cambia la IP o la máscara
+ * de una interfaz (sr_set_ether_ip, sr_set_ether_mask, sr_handle_hwinfo
+ * y los HELLO que traen otra máscara). Hay un único escritor, el hilo del
+ * plano de control; los lectores no toman locks y repiten la búsqueda si
+ * un contador de secuencia indica que la tabla cambió mientras leían.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOCAL_H
+#define SR_LOCAL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_instance;
+
+#define SR_LOCAL_HASH_BITS  7
+#define SR_LOCAL_HASH       (1 << SR_LOCAL_HASH_BITS)   /* -- más del doble de 2 * SR_IF_MAX + 1 -- */
+
+/* Clase de una dirección; SR_LOCAL_NONE también marca los lugares vacíos */
+#define SR_LOCAL_NONE   0
+#define SR_LOCAL_IFACE  1       /* -- IP de una interfaz -- */
+#define SR_LOCAL_BCAST  2       /* -- broadcast de una subred conectada -- */
+#define SR_LOCAL_MCAST  3       /* -- AllSPFRouters -- */
+
+struct sr_local_addr
+{
+    uint32_t ip;                /* -- orden de red -- */
+    uint16_t ifindex;           /* -- interfaz a la que pertenece -- */
+    uint8_t kind;
+};
+
+struct sr_local_table
+{
+    unsigned int seq;           /* -- impar mientras se reconstruye -- */
+    unsigned int count;
+    struct sr_local_addr slots[SR_LOCAL_HASH];
+};
+
+void sr_local_rebuild(struct sr_instance*);
+int sr_local_lookup(struct sr_instance*, uint32_t ip_nbo, unsigned int* ifindex);
+
+#endif /* -- SR_LOCAL_H -- */
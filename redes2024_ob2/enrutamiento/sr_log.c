@@ -0,0 +1,266 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ *
+ * Descripción:
+ *
+ * Colas de eventos por hilo y el hilo que las imprime, ver sr_log.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_log.h"
+#include "sr_counters.h"
+
+/* Espera del hilo de fondo cuando no hay eventos, en ns */
+#define SR_LOG_IDLE_NS 10000000L
+
+static __thread struct sr_log_ring* self = 0;
+
+static struct sr_log_ring* all_rings[SR_LOG_MAX_THREADS];
+static unsigned int num_rings = 0;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t rings_key;
+static pthread_once_t rings_once = PTHREAD_ONCE_INIT;
+
+/* La cola de un hilo que termina queda para otro hilo una vez vacía */
+static void sr_log_release(void* arg)
+{
+    struct sr_log_ring* r = arg;
+
+    __atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void sr_log_key_init(void)
+{
+    pthread_key_create(&rings_key, sr_log_release);
+}
+
+/* Asigna al hilo actual una cola libre o nueva; NULL si ya no quedan */
+static struct sr_log_ring* sr_log_register(void)
+{
+    struct sr_log_ring* r = 0;
+    unsigned int i;
+
+    pthread_once(&rings_once, sr_log_key_init);
+
+    pthread_mutex_lock(&rings_lock);
+    for (i = 0; i < num_rings && r == 0; i++)
+    {
+        if (!__atomic_load_n(&all_rings[i]->owned, __ATOMIC_ACQUIRE) &&
+            all_rings[i]->head == __atomic_load_n(&all_rings[i]->tail, __ATOMIC_ACQUIRE))
+        {
+            r = all_rings[i];
+        }
+    }
+    if (r == 0 && num_rings < SR_LOG_MAX_THREADS && (r = calloc(1, sizeof(*r))) != NULL)
+    {
+        all_rings[num_rings] = r;
+        __atomic_store_n(&num_rings, num_rings + 1, __ATOMIC_RELEASE);
+    }
+    if (r != 0)
+    {
+        r->owned = 1;
+    }
+    pthread_mutex_unlock(&rings_lock);
+
+    if (r != 0)
+    {
+        pthread_setspecific(rings_key, r);
+    }
+    self = r;
+    return r;
+}
+
+static void sr_log_ip(uint32_t ip, char* buf)
+{
+    struct in_addr addr;
+
+    addr.s_addr = ip;
+    inet_ntop(AF_INET, &addr, buf, INET_ADDRSTRLEN);
+}
+
+static void sr_log_format(unsigned int thread, const struct sr_log_rec* rec)
+{
+    char ip[INET_ADDRSTRLEN];
+
+    printf("[%lu.%06lu t%u] ", (unsigned long)(rec->ns / 1000000000ULL),
+           (unsigned long)(rec->ns % 1000000000ULL / 1000), thread);
+
+    switch (rec->ev)
+    {
+        case SR_EV_RX:
+            printf("rx ifindex %u, %u bytes\n", rec->a, rec->b);
+            break;
+        case SR_EV_FORWARD:
+            sr_log_ip(rec->a, ip);
+            printf("reenvío a %s por ifindex %u\n", ip, rec->b);
+            break;
+        case SR_EV_DROP:
+            sr_log_ip(rec->b, ip);
+            printf("descarte (%s) destino %s\n", sr_counters_drop_name(rec->a), ip);
+            break;
+        case SR_EV_ECHO_REPLY:
+            sr_log_ip(rec->a, ip);
+            printf("echo reply a %s\n", ip);
+            break;
+        case SR_EV_ICMP_ERROR:
+            sr_log_ip(rec->b, ip);
+            printf("ICMP tipo %u código %u a %s\n", rec->a >> 8, rec->a & 0xff, ip);
+            break;
+        case SR_EV_ICMP_UNROUTABLE:
+            sr_log_ip(rec->a, ip);
+            printf("error ICMP sin ruta a %s\n", ip);
+            break;
+        case SR_EV_ARP_QUEUE:
+            sr_log_ip(rec->a, ip);
+            printf("esperando ARP de %s en ifindex %u\n", ip, rec->b);
+            break;
+        case SR_EV_ARP_REQUEST:
+            sr_log_ip(rec->a, ip);
+            printf("ARP request por %s en ifindex %u\n", ip, rec->b);
+            break;
+        case SR_EV_ARP_REPLY:
+            sr_log_ip(rec->a, ip);
+            printf("ARP reply a %s en ifindex %u\n", ip, rec->b);
+            break;
+        case SR_EV_ARP_LEARN:
+            sr_log_ip(rec->a, ip);
+            printf("ARP de %s resuelto%s\n", ip, rec->b ? ", se envían los pendientes" : "");
+            break;
+        case SR_EV_FRAGMENT:
+            sr_log_ip(rec->a, ip);
+            printf("datagrama a %s enviado en %u fragmentos\n", ip, rec->b);
+            break;
+        default:
+            printf("evento %u (%u, %u)\n", rec->ev, rec->a, rec->b);
+            break;
+    }
+}
+
+/* Hilo de fondo: vacía las colas de todos los hilos e imprime */
+static void* sr_log_thread(void* arg)
+{
+    struct timespec idle;
+    struct sr_log_ring* r;
+    unsigned int i, n, head, tail;
+    int busy;
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = SR_LOG_IDLE_NS;
+
+    for (;;)
+    {
+        busy = 0;
+        n = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+        for (i = 0; i < n; i++)
+        {
+            r = all_rings[i];
+            head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+            for (tail = r->tail; tail != head; tail++)
+            {
+                sr_log_format(i, &r->ring[tail & (SR_LOG_RING - 1)]);
+            }
+            if (tail != r->tail)
+            {
+                __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+                busy = 1;
+            }
+        }
+
+        if (busy)
+        {
+            fflush(stdout);
+        }
+        else
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_record
+ *
+ * Encola un evento en la cola del hilo actual, que se registra en su
+ * primer evento. No bloquea: con la cola llena el evento se pierde.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_record(uint32_t ev, uint32_t a, uint32_t b)
+{
+    struct sr_log_ring* r = self;
+    struct sr_log_rec* rec;
+    struct timespec ts;
+    unsigned int head;
+
+    if (r == 0 && (r = sr_log_register()) == 0)
+    {
+        return;
+    }
+
+    head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= SR_LOG_RING)
+    {
+        r->lost++;
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec = &r->ring[head & (SR_LOG_RING - 1)];
+    rec->ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->ev = ev;
+    rec->a = a;
+    rec->b = b;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+} /* -- sr_log_record -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_start
+ *
+ * Lanza el hilo que imprime los eventos
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_start(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, sr_log_thread, NULL) != 0)
+    {
+        perror("pthread_create");
+    }
+    pthread_attr_destroy(&attr);
+} /* -- sr_log_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_log_print_stats
+ *
+ * Imprime los eventos perdidos con la cola llena, sumando todos los hilos
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_log_print_stats(void)
+{
+    unsigned long lost = 0;
+    unsigned int i, n;
+
+    n = __atomic_load_n(&num_rings, __ATOMIC_ACQUIRE);
+    for (i = 0; i < n; i++)
+    {
+        lost += all_rings[i]->lost;
+    }
+    printf("Eventos de log: %u hilos, %lu perdidos\n", n, lost);
+} /* -- sr_log_print_stats -- */
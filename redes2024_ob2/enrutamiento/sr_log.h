@@ -0,0 +1,118 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ *
+ * Descripción:
+ *
+ * Registro (log) con niveles fijados al compilar. Cada módulo tiene su
+ * nivel, SR_LOG_LEVEL_<módulo>, y todo mensaje de un nivel mayor queda en
+ * un if con condición constante que el compilador elimina junto con sus
+ * argumentos: un mensaje deshabilitado no cuesta nada. Los niveles se
+ * eligen con -DSR_LOG_LEVEL=... para los módulos del plano de datos y
+ * con -DSR_LOG_LEVEL_<módulo>=... para uno en particular.
+ *
+ * Hay tres formas de registrar:
+ *
+ *   sr_log        texto con printf, al momento; para el plano de control
+ *                 y errores poco frecuentes
+ *   sr_log_event  un evento del camino de reenvío: un registro binario
+ *                 de 24 bytes en una cola del hilo, sin locks ni formato;
+ *                 un hilo de fondo (sr_log_start) los vacía y los imprime.
+ *                 Con la cola llena el evento se pierde y se cuenta.
+ *   sr_log_dump   los cabezales completos con print_hdrs, al momento;
+ *                 sólo para depurar, en el nivel más alto
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#define SR_LOG_NONE     0
+#define SR_LOG_ERROR    1
+#define SR_LOG_WARN     2
+#define SR_LOG_INFO     3
+#define SR_LOG_DEBUG    4
+#define SR_LOG_TRACE    5
+
+#ifndef SR_LOG_LEVEL
+#define SR_LOG_LEVEL    SR_LOG_INFO
+#endif
+
+/* Módulos: reenvío IP e ICMP, ARP y plano de control (VNS, PWOSPF,
+   interfaces); el plano de control conserva sus mensajes Debug */
+#ifndef SR_LOG_LEVEL_IP
+#define SR_LOG_LEVEL_IP     SR_LOG_LEVEL
+#endif
+#ifndef SR_LOG_LEVEL_ARP
+#define SR_LOG_LEVEL_ARP    SR_LOG_LEVEL
+#endif
+#ifndef SR_LOG_LEVEL_CTRL
+#define SR_LOG_LEVEL_CTRL   SR_LOG_DEBUG
+#endif
+
+#define SR_LOG_RING         1024    /* -- registros por hilo, potencia de 2 -- */
+#define SR_LOG_MAX_THREADS  64
+
+/* Eventos binarios; a y b según el evento */
+enum sr_log_event_id
+{
+    SR_EV_RX,                   /* -- a: ifindex, b: largo -- */
+    SR_EV_FORWARD,              /* -- a: destino, b: ifindex de salida -- */
+    SR_EV_DROP,                 /* -- a: sr_drop_reason, b: destino -- */
+    SR_EV_ECHO_REPLY,           /* -- a: destino -- */
+    SR_EV_ICMP_ERROR,           /* -- a: tipo << 8 | código, b: destino -- */
+    SR_EV_ICMP_UNROUTABLE,      /* -- a: destino del error sin ruta -- */
+    SR_EV_ARP_QUEUE,            /* -- a: próximo salto, b: ifindex -- */
+    SR_EV_ARP_REQUEST,          /* -- a: IP buscada, b: ifindex -- */
+    SR_EV_ARP_REPLY,            /* -- a: IP que pidió, b: ifindex -- */
+    SR_EV_ARP_LEARN,            /* -- a: IP que respondió, b: 1 si había paquetes esperando -- */
+    SR_EV_FRAGMENT,             /* -- a: destino, b: cantidad de fragmentos -- */
+    SR_EV_COUNT
+};
+
+struct sr_log_rec
+{
+    uint64_t ns;                /* -- CLOCK_MONOTONIC -- */
+    uint32_t ev;
+    uint32_t a;
+    uint32_t b;
+    uint32_t pad;
+};
+
+struct sr_log_ring
+{
+    struct sr_log_rec ring[SR_LOG_RING];
+    unsigned int head;          /* -- la escribe el hilo dueño -- */
+    char pad_head[64 - sizeof(unsigned int)];
+    unsigned int tail;          /* -- la escribe el hilo de fondo -- */
+    char pad_tail[64 - sizeof(unsigned int)];
+    unsigned long lost;         /* -- eventos perdidos con la cola llena -- */
+    int owned;                  /* -- 0 si su hilo terminó y puede reusarse -- */
+};
+
+#define sr_log_enabled(mod, level)  ((level) <= SR_LOG_LEVEL_##mod)
+
+#define sr_log(mod, level, fmt, args...) \
+    do { if (sr_log_enabled(mod, level)) printf(fmt, ## args); } while (0)
+
+#define sr_log_event(mod, level, ev, a, b) \
+    do { if (sr_log_enabled(mod, level)) sr_log_record((ev), (a), (b)); } while (0)
+
+/* Quien lo usa incluye sr_utils.h */
+#define sr_log_dump(mod, buf, len) \
+    do { if (sr_log_enabled(mod, SR_LOG_TRACE)) print_hdrs((buf), (len)); } while (0)
+
+void sr_log_record(uint32_t ev, uint32_t a, uint32_t b);
+void sr_log_start(void);
+void sr_log_print_stats(void);
+
+#endif /* -- SR_LOG_H -- */
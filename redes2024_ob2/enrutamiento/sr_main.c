@@ -22,6 +22,9 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include <pwd.h>
 #include <sys/types.h>
 
@@ -32,6 +35,15 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_cksum.h"
+#include "sr_worker.h"
+#include "sr_egress.h"
+#include "sr_slowpath.h"
+#include "sr_graph.h"
+#include "sr_counters.h"
+#include "sr_dstcache.h"
+#include "sr_pktbuf.h"
+#include "sr_rcu.h"
 
 extern char* optarg;
 
@@ -50,6 +62,7 @@ static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
+static void sr_stats_start(struct sr_instance* sr, unsigned int period);
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -65,11 +78,21 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    char *fib_mode = 0;
+    unsigned int workers = 0;
+    unsigned int icmp_global = SR_ICMP_LIMIT_GLOBAL;
+    unsigned int icmp_iface = SR_ICMP_LIMIT_IFACE;
+    unsigned int icmp_source = SR_ICMP_LIMIT_SOURCE;
+    char *if_mtus = 0;
+    unsigned int egress_limit = 0;
+    unsigned int arp_size = SR_ARPCACHE_SZ;
+    unsigned int stats_period = 0;
+    sigset_t stats_signals;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:F:w:I:m:q:a:S:")) != EOF)
     {
         switch (c)
         {
@@ -101,11 +124,74 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'F':
+                fib_mode = optarg;
+                break;
+            case 'w':
+                workers = atoi((char *) optarg);
+                if(workers > SR_WORKER_MAX)
+                {
+                    fprintf(stderr,"At most %d workers\n", SR_WORKER_MAX);
+                    exit(1);
+                }
+                break;
+            case 'I':
+                if(sscanf(optarg, "%u,%u,%u",
+                          &icmp_global, &icmp_iface, &icmp_source) != 3)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'm':
+                if_mtus = optarg;
+                break;
+            case 'q':
+                egress_limit = atoi((char *) optarg);
+                if(egress_limit == 0 || egress_limit > SR_EGRESS_RING)
+                {
+                    fprintf(stderr,"Output queues hold 1 to %d packets\n", SR_EGRESS_RING);
+                    exit(1);
+                }
+                break;
+            case 'a':
+                arp_size = atoi((char *) optarg);
+                if(arp_size == 0 || arp_size > SR_ARPCACHE_MAX)
+                {
+                    fprintf(stderr,"The ARP cache holds 1 to %d neighbors\n", SR_ARPCACHE_MAX);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                stats_period = atoi((char *) optarg);
+                break;
         } /* switch */
     } /* -- while -- */
 
+    /* -- SIGUSR1 is only taken by the statistics thread, so block it
+          before any other thread is created -- */
+    sigemptyset(&stats_signals);
+    sigaddset(&stats_signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &stats_signals, NULL);
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr_icmp_limit_init(&(sr.icmp_limit), icmp_global, icmp_iface, icmp_source);
+    sr.if_mtus = if_mtus;
+    sr.arp_size = arp_size;
+    sr_adj_init(&(sr.adj), SR_ADJ_PER_NEIGHBOR * arp_size);
+    Debug("Checksum implementation: %s\n", sr_cksum_impl());
+
+    /* -- optional DIR-24-8 forwarding table on top of the trie -- */
+    if(fib_mode != 0 && strcmp(fib_mode, "trie") != 0)
+    {
+        if(strcmp(fib_mode, "dir24") != 0)
+        {
+            usage(argv[0]);
+            exit(1);
+        }
+        sr.fib_dir24 = 1;
+    }
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
@@ -159,6 +245,23 @@ int main(int argc, char **argv)
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
 
+    /* -- optionally queue output for a scheduler thread -- */
+    if(egress_limit > 0)
+    {
+        Debug("Starting output queues of %u packets\n", egress_limit);
+        sr_egress_start(&sr, egress_limit);
+    }
+
+    /* -- optionally hand frames off to forwarding workers -- */
+    if(workers > 0)
+    {
+        Debug("Starting %u forwarding workers\n", workers);
+        sr_workers_start(&sr, workers);
+    }
+
+    /* -- statistics on SIGUSR1 and, with -S, every stats_period seconds -- */
+    sr_stats_start(&sr, stats_period);
+
     /* -- whizbang main loop ;-) */
     while( sr_read_from_server(&sr) == 1);
 
@@ -178,11 +281,110 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-F trie|dir24] [-w workers] \n");
+    printf("           [-I icmp errors/s global,iface,source (0 = no limit)] \n");
+    printf("           [-m iface:mtu[,iface:mtu...]] [-q output queue packets] \n");
+    printf("           [-a arp cache neighbors] [-S stats period in seconds] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
+    printf("   icmp limits=%d,%d,%d\n",
+            SR_ICMP_LIMIT_GLOBAL, SR_ICMP_LIMIT_IFACE, SR_ICMP_LIMIT_SOURCE);
+    printf("   mtu=%d arp cache neighbors=%d\n", SR_IF_MTU, SR_ARPCACHE_SZ);
+    printf("   statistics are printed on SIGUSR1 and, with -S, periodically\n");
 } /* -- usage -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_print(..)
+ * Scope: local
+ *
+ * Print the counters and the statistics of every subsystem, preceded by
+ * the seconds since start so that rates can be taken between two dumps.
+ *
+ *---------------------------------------------------------------------------*/
+
+static time_t stats_start;
+static unsigned int stats_interval;
+
+static void sr_stats_print(struct sr_instance* sr)
+{
+    printf("-- Estadísticas a los %ld s --\n", (long)(time(NULL) - stats_start));
+
+    /* -- the FIB may be replaced meanwhile -- */
+    sr_rcu_read_lock();
+    sr_fib_print_stats(sr_rcu_dereference(sr->fib));
+    sr_rcu_read_unlock();
+
+    sr_dstcache_print_stats();
+    sr_pktbuf_print_stats();
+    sr_workers_print_stats(sr);
+    sr_slowpath_print_stats(sr);
+    sr_egress_print_stats(sr);
+    sr_arpcache_print_stats(&(sr->cache));
+    sr_adj_print_stats(&(sr->adj));
+    sr_graph_print_stats();
+    sr_counters_print(sr);
+    sr_icmp_limit_print_stats(&(sr->icmp_limit));
+    sr_log_print_stats();
+    fflush(stdout);
+} /* -- sr_stats_print -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_run(..)
+ * Scope: local
+ *
+ * Statistics thread: waits for SIGUSR1, which every other thread blocks,
+ * or for stats_interval seconds if it is not 0, and prints.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void* sr_stats_run(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct timespec period;
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    period.tv_sec = stats_interval;
+    period.tv_nsec = 0;
+
+    for(;;)
+    {
+        if(stats_interval > 0)
+        {
+            if(sigtimedwait(&signals, NULL, &period) == -1 && errno == EINTR)
+            { continue; }
+        }
+        else if(sigwaitinfo(&signals, NULL) == -1)
+        { continue; }
+
+        sr_stats_print(sr);
+    }
+
+    return NULL;
+} /* -- sr_stats_run -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_start(..)
+ * Scope: local
+ *---------------------------------------------------------------------------*/
+
+static void sr_stats_start(struct sr_instance* sr, unsigned int period)
+{
+    pthread_t thread;
+
+    /* REQUIRES */
+    assert(sr);
+
+    stats_start = time(NULL);
+    stats_interval = period;
+    if(pthread_create(&thread, &(sr->attr), sr_stats_run, sr) != 0)
+    {
+        perror("pthread_create");
+        assert(0);
+    }
+} /* -- sr_stats_start -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_set_user(..)
  * Scope: local
@@ -225,6 +427,8 @@ static void sr_destroy_instance(struct sr_instance* sr)
         sr_dump_close(sr->logfile);
     }
 
+    sr_fib_free(sr->fib);
+
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
     */
@@ -247,8 +451,21 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    sr->num_ifs = 0;
+    memset(sr->if_hash, 0, sizeof(sr->if_hash));
+    memset(&(sr->local), 0, sizeof(sr->local));
     sr->routing_table = 0;
+    sr->fib = sr_fib_build(0, 0, 0);
+    sr->fib_dir24 = 0;
+    sr_cksum_init();
+    sr->if_mtus = 0;
+    sr->arp_size = SR_ARPCACHE_SZ;
     sr->logfile = 0;
+    pthread_mutex_init(&(sr->send_lock), NULL);
+    sr->workers = 0;
+    sr->num_workers = 0;
+    sr->slowpath = 0;
+    sr->egress = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -285,14 +502,7 @@ int sr_verify_routing_table(struct sr_instance* sr)
     while(rt_walker)
     {
         /* -- check to see if interface exists -- */
-        if_walker = sr->if_list;
-        while(if_walker)
-        {
-            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
-                    == 0)
-            { break; }
-            if_walker = if_walker->next;
-        }
+        if_walker = sr_get_interface(sr, rt_walker->interface);
         if(if_walker == 0)
         { ret++; } /* -- interface not found! -- */
 
@@ -313,5 +523,6 @@ static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
     printf("Loading routing table\n");
     printf("---------------------------------------------\n");
     sr_print_routing_table(sr);
+    sr_fib_print_stats(sr->fib);
     printf("---------------------------------------------\n");
 }
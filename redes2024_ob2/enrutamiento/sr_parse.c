@@ -0,0 +1,153 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_parse.c
+ *
+ * Descripción:
+ *
+ * Análisis de tramas en una sola pasada, ver sr_parse.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+
+#include <netinet/in.h>
+
+#include "sr_parse.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_local.h"
+#include "sr_utils.h"
+#include "pwospf_protocol.h"
+
+extern uint8_t sr_multicast_mac[ETHER_ADDR_LEN];
+
+/*---------------------------------------------------------------------
+ * Method: sr_parse_frame
+ *
+ * Valida los cabezales Ethernet e IP (o ARP) de la trama y completa
+ * meta, salvo local y for_us. Devuelve 0 si la trama es inválida.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_parse_frame(uint8_t* frame, unsigned int len, struct sr_pkt_meta* meta)
+{
+    sr_ethernet_hdr_t* eHdr = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ipHdr;
+    unsigned int hl, ip_len;
+
+    /* -- REQUIRES -- */
+    assert(frame);
+    assert(meta);
+
+    memset(meta, 0, sizeof(*meta));
+    if (len < sizeof(sr_ethernet_hdr_t))
+    {
+        return 0;
+    }
+    meta->ethertype = ntohs(eHdr->ether_type);
+    meta->l3_off = sizeof(sr_ethernet_hdr_t);
+
+    if (meta->ethertype == ethertype_arp)
+    {
+        meta->l3_len = sizeof(sr_arp_hdr_t);
+        meta->l4_off = meta->l3_off + meta->l3_len;
+        return len >= meta->l4_off;
+    }
+    if (meta->ethertype != ethertype_ip || len < meta->l3_off + sizeof(sr_ip_hdr_t))
+    {
+        return 0;
+    }
+
+    /* El cabezal y el datagrama entran en la trama; lo que sobra al
+       final es relleno de Ethernet */
+    ipHdr = (sr_ip_hdr_t*)(frame + meta->l3_off);
+    hl = ipHdr->ip_hl * 4;
+    ip_len = ntohs(ipHdr->ip_len);
+    if (ipHdr->ip_v != 4 || hl < sizeof(sr_ip_hdr_t) || ip_len < hl ||
+        meta->l3_off + ip_len > len)
+    {
+        return 0;
+    }
+    if (ip_cksum(ipHdr, hl) != ipHdr->ip_sum)
+    {
+        return 0;
+    }
+
+    meta->l3_len = ip_len;
+    meta->l4_off = meta->l3_off + hl;
+    meta->l4_len = ip_len - hl;
+    meta->proto = ipHdr->ip_p;
+    return 1;
+} /* -- sr_parse_frame -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_parse_check_l4
+ *
+ * Valida el largo y la suma del cabezal ICMP u OSPF de un datagrama ya
+ * analizado; los demás protocolos no se revisan
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_parse_check_l4(uint8_t* frame, const struct sr_pkt_meta* meta)
+{
+    sr_icmp_hdr_t* icmpHdr;
+    ospfv2_hdr_t* ospfHdr;
+
+    /* -- REQUIRES -- */
+    assert(frame);
+    assert(meta);
+
+    if (meta->ethertype != ethertype_ip)
+    {
+        return 1;
+    }
+
+    if (meta->proto == ip_protocol_icmp)
+    {
+        icmpHdr = (sr_icmp_hdr_t*)(frame + meta->l4_off);
+        return meta->l4_len >= sizeof(sr_icmp_hdr_t) &&
+               icmp_cksum(icmpHdr, meta->l4_len) == icmpHdr->icmp_sum;
+    }
+    if (meta->proto == ip_protocol_ospfv2)
+    {
+        ospfHdr = (ospfv2_hdr_t*)(frame + meta->l4_off);
+        return meta->l4_len >= sizeof(ospfv2_hdr_t) &&
+               ospfv2_cksum(ospfHdr, meta->l4_len) == ospfHdr->csum;
+    }
+    return 1;
+} /* -- sr_parse_check_l4 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_parse_packet
+ *
+ * Analiza la trama, clasifica su destino y, sólo si es para el router,
+ * valida también la capa 4. Devuelve 0 si la trama es inválida.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_parse_packet(struct sr_instance* sr, uint8_t* frame, unsigned int len,
+                    struct sr_pkt_meta* meta)
+{
+    sr_ethernet_hdr_t* eHdr = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ipHdr;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if (!sr_parse_frame(frame, len, meta))
+    {
+        return 0;
+    }
+    if (meta->ethertype != ethertype_ip)
+    {
+        return 1;
+    }
+
+    ipHdr = (sr_ip_hdr_t*)(frame + meta->l3_off);
+    meta->local = sr_local_lookup(sr, ipHdr->ip_dst, NULL);
+    meta->for_us = (meta->local == SR_LOCAL_IFACE) ||
+                   (meta->local == SR_LOCAL_MCAST && meta->proto == ip_protocol_ospfv2 &&
+                    memcmp(eHdr->ether_dhost, sr_multicast_mac, ETHER_ADDR_LEN) == 0);
+
+    return !meta->for_us || sr_parse_check_l4(frame, meta);
+} /* -- sr_parse_packet -- */
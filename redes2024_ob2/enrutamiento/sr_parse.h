@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_parse.h
+ *
+ * Descripción:
+ *
+ * Análisis de una trama en una sola pasada. sr_parse_packet valida la
+ * trama y deja en struct sr_pkt_meta los desplazamientos y largos de cada
+ * capa, el protocolo y si el destino es el router; las etapas siguientes
+ * usan esos datos en lugar de volver a recorrer los cabezales.
+ *
+ * La validación depende del destino:
+ *
+ *   tránsito     largo de la trama, versión, ip_hl e ip_len coherentes con
+ *                el largo y suma del cabezal IP; el contenido no se mira
+ *   al router    además el cabezal y la suma de ICMP u OSPF sobre todo el
+ *                datagrama
+ *
+ * Un paquete es para el router si va a una de sus direcciones, o si es
+ * OSPF a la dirección y MAC multicast de PWOSPF.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PARSE_H
+#define SR_PARSE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_instance;
+
+struct sr_pkt_meta
+{
+    uint16_t ethertype;         /* -- orden de host -- */
+    uint16_t l3_off;
+    uint16_t l3_len;            /* -- ip_len, o el cabezal ARP -- */
+    uint16_t l4_off;            /* -- l3_off + ip_hl * 4 -- */
+    uint16_t l4_len;
+    uint8_t proto;              /* -- ip_p, 0 en ARP -- */
+    uint8_t local;              /* -- SR_LOCAL_* del destino IP -- */
+    uint8_t for_us;
+};
+
+int sr_parse_frame(uint8_t* frame, unsigned int len, struct sr_pkt_meta* meta);
+int sr_parse_check_l4(uint8_t* frame, const struct sr_pkt_meta* meta);
+int sr_parse_packet(struct sr_instance*, uint8_t* frame, unsigned int len,
+                    struct sr_pkt_meta* meta);
+
+#endif /* -- SR_PARSE_H -- */
@@ -0,0 +1,245 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pktbuf.c
+ *
+ * Descripción:
+ *
+ * Pools de buffers de paquetes por hilo, ver sr_pktbuf.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sr_pktbuf.h"
+
+#define SR_PKTBUF_MAX_THREADS 64
+
+struct sr_pktbuf_pool
+{
+    struct sr_pktbuf* free;         /* -- buffers libres, sólo los usa el dueño -- */
+    struct sr_pktbuf* remote;       /* -- devueltos por otros hilos -- */
+    unsigned long gets;
+    unsigned long mallocs;          /* -- pedidos sin buffers libres -- */
+    unsigned long copies;           /* -- envíos que copiaron la trama -- */
+    int owned;                      /* -- 0 si su hilo terminó y puede reusarse -- */
+};
+
+static __thread struct sr_pktbuf_pool* pool = 0;
+
+/* Pool común de sr_pktbuf_get_shared; sus buffers vuelven por la lista
+   remota como los de cualquier otro pool */
+static struct sr_pktbuf_pool shared_pool;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct sr_pktbuf_pool all_pools[SR_PKTBUF_MAX_THREADS];
+static unsigned int num_pools = 0;
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t pools_key;
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+/* El pool de un hilo que termina, con sus buffers, pasa al próximo hilo
+   nuevo; los buffers que aún circulan vuelven a su lista remota. Así los
+   hilos que se reemplazan no reservan un pool cada uno. */
+static void sr_pktbuf_release(void* arg)
+{
+    struct sr_pktbuf_pool* p = arg;
+
+    pthread_mutex_lock(&pools_lock);
+    p->owned = 0;
+    pthread_mutex_unlock(&pools_lock);
+}
+
+static void sr_pktbuf_key_init(void)
+{
+    pthread_key_create(&pools_key, sr_pktbuf_release);
+}
+
+/* Pool del hilo; la primera vez adopta uno libre o toma uno nuevo */
+static struct sr_pktbuf_pool* sr_pktbuf_thread_pool(void)
+{
+    unsigned int i;
+
+    if (pool == 0)
+    {
+        pthread_once(&pools_once, sr_pktbuf_key_init);
+
+        pthread_mutex_lock(&pools_lock);
+        for (i = 0; i < num_pools && pool == 0; i++)
+        {
+            if (!all_pools[i].owned)
+            {
+                pool = &all_pools[i];
+            }
+        }
+        if (pool == 0)
+        {
+            assert(num_pools < SR_PKTBUF_MAX_THREADS);
+            pool = &all_pools[num_pools++];
+        }
+        pool->owned = 1;
+        pthread_mutex_unlock(&pools_lock);
+        pthread_setspecific(pools_key, pool);
+    }
+    return pool;
+}
+
+/* Reserva los count buffers del pool en su primer pedido */
+static void sr_pktbuf_reserve(struct sr_pktbuf_pool* p, int count)
+{
+    struct sr_pktbuf* bufs;
+    int i;
+
+    bufs = (struct sr_pktbuf*)malloc(count * sizeof(struct sr_pktbuf));
+    assert(bufs);
+    for (i = 0; i < count; i++)
+    {
+        bufs[i].pool = p;
+        bufs[i].next = (i + 1 < count) ? &bufs[i + 1] : NULL;
+    }
+    p->free = bufs;
+}
+
+/* Saca un buffer libre de p, o lo pide con malloc; sólo un hilo a la
+   vez toma buffers de p */
+static struct sr_pktbuf* sr_pktbuf_pop(struct sr_pktbuf_pool* p, int count)
+{
+    struct sr_pktbuf* pb;
+
+    if (p->gets == 0 && p->free == NULL)
+    {
+        sr_pktbuf_reserve(p, count);
+    }
+    if (p->free == NULL)
+    {
+        p->free = __atomic_exchange_n(&p->remote, NULL, __ATOMIC_ACQUIRE);
+    }
+
+    pb = p->free;
+    if (pb != NULL)
+    {
+        p->free = pb->next;
+    }
+    else
+    {
+        pb = (struct sr_pktbuf*)malloc(sizeof(struct sr_pktbuf));
+        assert(pb);
+        pb->pool = NULL;
+        p->mallocs++;
+    }
+
+    p->gets++;
+    pb->next = NULL;
+    return pb;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pktbuf_get
+ *
+ * Devuelve un buffer libre del pool del hilo
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pktbuf* sr_pktbuf_get(void)
+{
+    return sr_pktbuf_pop(sr_pktbuf_thread_pool(), SR_PKTBUF_COUNT);
+} /* -- sr_pktbuf_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pktbuf_get_shared
+ *
+ * Devuelve un buffer del pool común, para los hilos que sólo copian
+ * alguna trama de vez en cuando y no deben reservar un pool propio
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pktbuf* sr_pktbuf_get_shared(void)
+{
+    struct sr_pktbuf* pb;
+
+    pthread_mutex_lock(&shared_lock);
+    pb = sr_pktbuf_pop(&shared_pool, SR_PKTBUF_SHARED);
+    pthread_mutex_unlock(&shared_lock);
+    return pb;
+} /* -- sr_pktbuf_get_shared -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pktbuf_put
+ *
+ * Devuelve el buffer a su pool; puede llamarse desde cualquier hilo
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pktbuf_put(struct sr_pktbuf* pb)
+{
+    struct sr_pktbuf_pool* owner;
+
+    /* -- REQUIRES -- */
+    assert(pb);
+
+    owner = pb->pool;
+    if (owner == NULL)
+    {
+        free(pb);
+    }
+    else if (owner == pool)
+    {
+        pb->next = owner->free;
+        owner->free = pb;
+    }
+    else
+    {
+        pb->next = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&owner->remote, &pb->next, pb, 1,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+            /* pb->next quedó con la cabeza actual, se reintenta */
+        }
+    }
+} /* -- sr_pktbuf_put -- */
+
+/* Lo llama sr_send_packet cuando tiene que copiar la trama; un hilo sin
+   pool propio lo cuenta en el común */
+void sr_pktbuf_count_copy(void)
+{
+    if (pool != 0)
+    {
+        pool->copies++;
+    }
+    else
+    {
+        __atomic_fetch_add(&shared_pool.copies, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pktbuf_print_stats
+ *
+ * Imprime los contadores sumando los de todos los hilos
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pktbuf_print_stats(void)
+{
+    unsigned long gets = 0, mallocs = 0, copies = 0;
+    unsigned int i;
+
+    pthread_mutex_lock(&pools_lock);
+    for (i = 0; i < num_pools; i++)
+    {
+        gets += all_pools[i].gets;
+        mallocs += all_pools[i].mallocs;
+        copies += all_pools[i].copies;
+    }
+    pthread_mutex_unlock(&pools_lock);
+
+    pthread_mutex_lock(&shared_lock);
+    gets += shared_pool.gets;
+    mallocs += shared_pool.mallocs;
+    pthread_mutex_unlock(&shared_lock);
+    copies += __atomic_load_n(&shared_pool.copies, __ATOMIC_RELAXED);
+
+    printf("Buffers de paquetes: %lu usados, %lu con malloc, %lu envíos con copia\n",
+           gets, mallocs, copies);
+} /* -- sr_pktbuf_print_stats -- */
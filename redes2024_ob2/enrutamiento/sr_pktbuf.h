@@ -0,0 +1,66 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pktbuf.h
+ *
+ * Descripción:
+ *
+ * Buffers de paquetes preasignados. Cada hilo tiene su propio pool de
+ * SR_PKTBUF_COUNT buffers de tamaño fijo que se reserva una sola vez; los
+ * mensajes que llegan del servidor VNS se leen directo en un buffer del
+ * pool, la trama se reenvía desde la misma memoria y el buffer vuelve al
+ * pool, sin ningún malloc por paquete. El pool de un hilo que termina lo
+ * adopta el próximo hilo nuevo.
+ *
+ * Antes de la trama se dejan SR_PKTBUF_HEADROOM bytes libres. Al leer, el
+ * cabezal c_packet_header del mensaje queda justo delante de la trama, de
+ * modo que sr_send_packet_inplace (sr_vns_comm.c) puede escribir ahí el
+ * cabezal de salida en vez de copiar la trama a otro buffer.
+ *
+ * Un buffer puede devolverse desde cualquier hilo: si no es el dueño, el
+ * buffer se apila en una lista sin locks que el dueño recupera cuando se
+ * le vacía el pool. Si aun así no hay buffers se pide uno con malloc y se
+ * cuenta; con el pool bien dimensionado ese contador queda en 0. También
+ * se cuentan los envíos que copian la trama (sr_send_packet), que no deben
+ * aparecer en el reenvío.
+ *
+ * Sólo el hilo que lee del servidor toma buffers de su pool. Los que
+ * copian una trama para encolarla en una salida, como los hilos de corta
+ * vida de PWOSPF, usan sr_pktbuf_get_shared: un pool chico común a todos,
+ * con malloc cuando se agota, que el hilo de salida devuelve.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PKTBUF_H
+#define SR_PKTBUF_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#define SR_PKTBUF_HEADROOM  64      /* -- bytes libres antes de la trama -- */
+#define SR_PKTBUF_SIZE      10240   /* -- headroom + mensaje VNS más largo -- */
+#define SR_PKTBUF_COUNT     3328    /* -- buffers por hilo, más que los que caben en las colas de los trabajadores y del camino lento -- */
+#define SR_PKTBUF_SHARED    64      /* -- buffers del pool común de los envíos con copia -- */
+
+struct sr_pktbuf_pool;
+
+struct sr_pktbuf
+{
+    struct sr_pktbuf_pool* pool;    /* -- dueño, NULL si vino de malloc -- */
+    struct sr_pktbuf* next;
+    uint8_t data[SR_PKTBUF_SIZE];
+};
+
+/* Comienzo de la trama dentro del buffer */
+#define sr_pktbuf_frame(pb) ((pb)->data + SR_PKTBUF_HEADROOM)
+
+struct sr_pktbuf* sr_pktbuf_get(void);
+struct sr_pktbuf* sr_pktbuf_get_shared(void);
+void sr_pktbuf_put(struct sr_pktbuf*);
+void sr_pktbuf_count_copy(void);
+void sr_pktbuf_print_stats(void);
+
+#endif /* -- SR_PKTBUF_H -- */
@@ -176,6 +176,7 @@ static void *pwospf_run_thread(void *arg)
         }
         int_temp = int_temp->next;
     }
+    sr_publish_fib(sr);
 
     Debug("\n-> PWOSPF: Printing the forwarding table\n");
     sr_print_routing_table(sr);
@@ -491,7 +492,7 @@ void *send_lsu(void *arg)
         return NULL;
     }
     else {
-        printf("No es cero \n");
+        sr_log(CTRL, SR_LOG_DEBUG, "No es cero \n");
         sr_print_if(lsu_param->interface);
     }
 
@@ -558,7 +559,7 @@ void *send_lsu(void *arg)
 
         while (entry != NULL)
         {
-            printf("ENTRADA DE LA TABLA \n");
+            sr_log(CTRL, SR_LOG_DEBUG, "ENTRADA DE LA TABLA \n");
             sr_print_routing_entry(entry);
             /* Solo envío entradas directamente conectadas y agreagadas a mano*/
             if (entry->admin_dst <= 1)
@@ -584,32 +585,32 @@ void *send_lsu(void *arg)
     }
     else
     {
-        printf("ALGO ES NULL \n");
+        sr_log(CTRL, SR_LOG_DEBUG, "ALGO ES NULL \n");
     }
 
     tx_ospf_hdr->csum = ospfv2_cksum(tx_ospf_hdr, len - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t));
 
     /* Me falta la MAC para poder enviar el paquete, la busco en la cache ARP*/
-    struct sr_arpentry *arpEntry = sr_arpcache_lookup(&(lsu_param->sr->cache), lsu_param->interface->neighbor_ip);
+    struct sr_arpentry arpEntry;
     
 
-    if (arpEntry != NULL)
+    if (sr_arpcache_lookup(&(lsu_param->sr->cache), lsu_param->interface->neighbor_ip, &arpEntry))
     {
-        printf("HAY ARP ENTRY \n");
-        printf("PAQUETE LSU \n");
+        sr_log(CTRL, SR_LOG_DEBUG, "HAY ARP ENTRY \n");
+        sr_log(CTRL, SR_LOG_DEBUG, "PAQUETE LSU \n");
         /* Si la entrada existe, usar la dirección MAC de arpEntry */
-        memcpy(tx_e_hdr->ether_dhost, arpEntry->mac, ETHER_ADDR_LEN);
+        memcpy(tx_e_hdr->ether_dhost, arpEntry.mac, ETHER_ADDR_LEN);
         sr_send_packet(lsu_param->sr, lsu_packet, len, lsu_param->interface->name);
-        /* Liberar la entrada ARP obtenida */
-        free(arpEntry);
     }
     else
     {
-        printf("NO HAY ARP ENTRY \n");
+        sr_log(CTRL, SR_LOG_DEBUG, "NO HAY ARP ENTRY \n");
         /* Si no hay entrada ARP, encolar la solicitud ARP*/
-        print_hdrs(lsu_packet , len);
-        struct sr_arpreq *req = sr_arpcache_queuereq(&(lsu_param->sr->cache), lsu_param->interface->neighbor_ip, lsu_packet, len, lsu_param->interface->name);
+        sr_log_dump(CTRL, lsu_packet, len);
+        pthread_mutex_lock(&(lsu_param->sr->cache.lock));
+        struct sr_arpreq *req = sr_arpcache_queuereq(&(lsu_param->sr->cache), lsu_param->interface->neighbor_ip, lsu_packet, len, lsu_param->interface->ifindex);
         handle_arpreq(lsu_param->sr, req); /* Maneja la solicitud ARP, enviará el ARP request si es necesario */
+        pthread_mutex_unlock(&(lsu_param->sr->cache.lock));
     }
 
     return NULL;
@@ -644,12 +645,7 @@ void sr_handle_pwospf_hello_packet(struct sr_instance *sr, uint8_t *packet, unsi
     Debug("      [Neighbor IP = %s]\n", inet_ntoa(*(struct in_addr *)&neighbor_ip));
     Debug("      [Network Mask = %s]\n", inet_ntoa(*(struct in_addr *)&net_mask));
 
-    if (!is_packet_valid(packet, length))
-    {
-        Debug("-> PWOSPF: HELLO Packet dropped, invalid\n");
-        return;
-    }
-
+    /* Largo y suma de OSPF ya los validó sr_parse_packet */
     if (hello_hdr->nmask != rx_if->mask) /*net_mask.s_addr != rx_if->mask*/
     {
         Debug("-> PWOSPF: HELLO Packet dropped, invalid hello network mask\n");
@@ -678,7 +674,12 @@ void sr_handle_pwospf_hello_packet(struct sr_instance *sr, uint8_t *packet, unsi
     }*/
     rx_if->neighbor_id = ospf_hdr->rid;
     rx_if->neighbor_ip = ip_hdr->ip_src;
-    rx_if->mask = hello_hdr->nmask;
+    if (rx_if->mask != hello_hdr->nmask)
+    {
+        /* Cambia el broadcast de la subred */
+        rx_if->mask = hello_hdr->nmask;
+        sr_local_rebuild(sr);
+    }
 
     struct in_addr id_neighbor;
     id_neighbor.s_addr = ospf_hdr->rid;
@@ -759,12 +760,7 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
     /* Imprimo info del paquete recibido*/
     Debug("-> PWOSPF: Detecting LSU Packet from [Neighbor ID = %s, IP = %s]\n", inet_ntoa(neighbor_id), inet_ntoa(neighbor_ip));
 
-    /* Chequeo checksum */
-    if (!is_packet_valid(rx_lsu_param->packet, rx_lsu_param->length))
-    {
-        Debug("-> PWOSPF: LSU Packet dropped, invalid checksum\n");
-        return NULL;
-    }
+    /* El checksum ya lo verificó sr_parse_packet antes de crear este hilo */
 
     /* Obtengo el Router ID del router originario del LSU y chequeo si no es mío*/
     if (rx_ospfv2_hdr->rid == g_router_id.s_addr)
@@ -829,9 +825,12 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
     }
     else
     {
+        /* El TTL del LSU comparte palabra con el campo unused: ajuste incremental */
+        uint16_t old_word, new_word;
+        memcpy(&old_word, &rx_ospfv2_lsu_hdr->unused, sizeof(old_word));
         rx_ospfv2_lsu_hdr->ttl--;
-        rx_ospfv2_hdr->csum = 0;
-        rx_ospfv2_hdr->csum = ospfv2_cksum(rx_ospfv2_hdr , rx_lsu_param->length -(sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t)));
+        memcpy(&new_word, &rx_ospfv2_lsu_hdr->unused, sizeof(new_word));
+        rx_ospfv2_hdr->csum = cksum_adjust(rx_ospfv2_hdr->csum, old_word, new_word);
         while (temp_int != NULL)
         {
             if ((strcmp(temp_int->name, rx_lsu_param->rx_if->name) != 0 && (temp_int->neighbor_id)))
@@ -840,34 +839,29 @@ void *sr_handle_pwospf_lsu_packet(void *arg)
                 memcpy(((sr_ethernet_hdr_t *)(rx_lsu_param->packet))->ether_shost, temp_int->addr , ETHER_ADDR_LEN);
                 
 
-                /* Ajusto paquete IP, origen y checksum*/
-                ((sr_ip_hdr_t *)(rx_lsu_param->packet + sizeof(sr_ethernet_hdr_t)))->ip_dst = temp_int->neighbor_ip;
-
-                /* IP Checksum */
-                ((sr_ip_hdr_t *)(rx_lsu_param->packet + sizeof(sr_ethernet_hdr_t)))->ip_sum = 0;
-
-                /* Source IP address */
-                ((sr_ip_hdr_t *)(rx_lsu_param->packet + sizeof(sr_ethernet_hdr_t)))->ip_src = temp_int->ip;
+                /* Ajusto paquete IP, origen y destino; el checksum se corrige
+                   en forma incremental por cada dirección que cambia */
+                ip_hdr->ip_sum = cksum_adjust32(ip_hdr->ip_sum, ip_hdr->ip_dst, temp_int->neighbor_ip);
+                ip_hdr->ip_dst = temp_int->neighbor_ip;
 
-                /* Re-Calculate checksum of the IP header */
-                ((sr_ip_hdr_t *)(rx_lsu_param->packet + sizeof(sr_ethernet_hdr_t)))->ip_sum = ip_cksum(((uint8_t *)(rx_lsu_param->packet + sizeof(sr_ethernet_hdr_t))),
-                                                                                                    sizeof(sr_ip_hdr_t));
+                ip_hdr->ip_sum = cksum_adjust32(ip_hdr->ip_sum, ip_hdr->ip_src, temp_int->ip);
+                ip_hdr->ip_src = temp_int->ip;
 
                 
-                struct sr_arpentry *arpEntry = sr_arpcache_lookup(&(rx_lsu_param->sr->cache), temp_int->neighbor_ip);
-                if (arpEntry != NULL)
+                struct sr_arpentry arpEntry;
+                if (sr_arpcache_lookup(&(rx_lsu_param->sr->cache), temp_int->neighbor_ip, &arpEntry))
                     {
                         /* Si la entrada existe, usar la dirección MAC de arpEntry */
-                        memcpy(((sr_ethernet_hdr_t *)(rx_lsu_param->packet))->ether_dhost, arpEntry->mac, ETHER_ADDR_LEN);
+                        memcpy(((sr_ethernet_hdr_t *)(rx_lsu_param->packet))->ether_dhost, arpEntry.mac, ETHER_ADDR_LEN);
                         sr_send_packet(rx_lsu_param->sr, rx_lsu_param->packet, rx_lsu_param->length, temp_int->name);
-                        /* Liberar la entrada ARP obtenida */
-                        free(arpEntry);
                     }
                     else
                     {
                         /* Si no hay entrada ARP, encolar la solicitud ARP*/
-                        struct sr_arpreq *req = sr_arpcache_queuereq(&(rx_lsu_param->sr->cache), temp_int->neighbor_ip, rx_lsu_param->packet, rx_lsu_param->length, temp_int->name);
+                        pthread_mutex_lock(&(rx_lsu_param->sr->cache.lock));
+                        struct sr_arpreq *req = sr_arpcache_queuereq(&(rx_lsu_param->sr->cache), temp_int->neighbor_ip, rx_lsu_param->packet, rx_lsu_param->length, temp_int->ifindex);
                         handle_arpreq(rx_lsu_param->sr, req); /* Maneja la solicitud ARP, enviará el ARP request si es necesario */
+                        pthread_mutex_unlock(&(rx_lsu_param->sr->cache.lock));
                     }
             }
 
@@ -0,0 +1,117 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rcu.c
+ *
+ * Descripción:
+ *
+ * Implementación de las secciones de lectura y del período de gracia
+ * descritos en sr_rcu.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "sr_rcu.h"
+
+/* Estado de un hilo lector. La época vale 0 fuera de una sección de
+   lectura. Se rellena a una línea de caché para que los lectores no
+   compartan líneas entre sí. */
+struct sr_rcu_reader
+{
+    unsigned long epoch;
+    char pad[64 - sizeof(unsigned long)];
+};
+
+static struct sr_rcu_reader readers[SR_RCU_MAX_THREADS];
+static unsigned int num_readers = 0;
+static unsigned long global_epoch = 1;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct sr_rcu_reader* self = 0;
+static __thread unsigned int depth = 0;
+
+/* Registra al hilo actual como lector */
+static struct sr_rcu_reader* sr_rcu_register(void)
+{
+    struct sr_rcu_reader* reader;
+
+    pthread_mutex_lock(&registry_lock);
+    assert(num_readers < SR_RCU_MAX_THREADS);
+    reader = &readers[num_readers];
+    reader->epoch = 0;
+    __atomic_store_n(&num_readers, num_readers + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registry_lock);
+
+    return reader;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_read_lock
+ *
+ * Comienza una sección de lectura. Las referencias obtenidas con
+ * sr_rcu_dereference son válidas hasta sr_rcu_read_unlock.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_read_lock(void)
+{
+    if (self == 0)
+    {
+        self = sr_rcu_register();
+    }
+
+    if (depth++ > 0)
+    {
+        return;
+    }
+
+    /* El store debe ser visible antes de leer cualquier puntero publicado */
+    __atomic_store_n(&self->epoch, __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_SEQ_CST);
+} /* -- sr_rcu_read_lock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_read_unlock
+ *
+ * Termina la sección de lectura del hilo actual
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_read_unlock(void)
+{
+    assert(self && depth > 0);
+    if (--depth == 0)
+    {
+        __atomic_store_n(&self->epoch, 0, __ATOMIC_RELEASE);
+    }
+} /* -- sr_rcu_read_unlock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_synchronize
+ *
+ * Espera a que terminen las secciones de lectura que comenzaron antes
+ * de la llamada. No debe llamarse desde una sección de lectura.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_synchronize(void)
+{
+    unsigned long target, epoch;
+    unsigned int i, count;
+
+    target = __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+    count = __atomic_load_n(&num_readers, __ATOMIC_ACQUIRE);
+
+    for (i = 0; i < count; i++)
+    {
+        for (;;)
+        {
+            epoch = __atomic_load_n(&readers[i].epoch, __ATOMIC_ACQUIRE);
+            if (epoch == 0 || epoch >= target)
+            {
+                break;
+            }
+            sched_yield();
+        }
+    }
+} /* -- sr_rcu_synchronize -- */
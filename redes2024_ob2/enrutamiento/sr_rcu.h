@@ -0,0 +1,36 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rcu.h
+ *
+ * Descripción:
+ *
+ * Reclamación de memoria por épocas, al estilo RCU. Los lectores marcan
+ * el inicio y el fin de cada sección de lectura sin tomar locks; el
+ * escritor publica la nueva versión de una estructura con un único store
+ * atómico y llama a sr_rcu_synchronize antes de liberar la anterior.
+ *
+ * sr_rcu_synchronize avanza la época global y espera a que todo hilo que
+ * esté dentro de una sección de lectura haya entrado en la nueva época;
+ * a partir de ese momento ningún lector puede tener una referencia a la
+ * versión reemplazada.
+ *
+ * Cada hilo lector se registra solo en su primera sección de lectura.
+ * Las secciones pueden anidarse; sólo cuenta la más externa.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RCU_H
+#define SR_RCU_H
+
+#define SR_RCU_MAX_THREADS 64
+
+void sr_rcu_read_lock(void);
+void sr_rcu_read_unlock(void);
+void sr_rcu_synchronize(void);
+
+/* Publica un puntero compartido, visible para los lectores en un solo paso */
+#define sr_rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/* Lee un puntero publicado con sr_rcu_assign_pointer */
+#define sr_rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+
+#endif /* -- SR_RCU_H -- */
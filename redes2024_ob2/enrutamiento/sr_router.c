@@ -20,6 +20,10 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_rcu.h"
+#include "sr_dstcache.h"
+#include "sr_counters.h"
+#include "sr_frag.h"
 #include "pwospf_protocol.h"
 #include "sr_pwospf.h"
 
@@ -49,7 +53,7 @@ void sr_init(struct sr_instance *sr)
   sr_multicast_mac[5] = 0x05;
 
   /* Inicializa la caché y el hilo de limpieza de la caché */
-  sr_arpcache_init(&(sr->cache));
+  sr_arpcache_init(&(sr->cache), sr->arp_size, &(sr->adj));
 
   /* Inicializa los atributos del hilo */
   pthread_attr_init(&(sr->attr));
@@ -61,55 +65,38 @@ void sr_init(struct sr_instance *sr)
   /* Hilo para gestionar el timeout del caché ARP */
   pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
 
+  /* Hilo que imprime los eventos del log */
+  sr_log_start();
+
 } /* -- sr_init -- */
 
-/* Envía un paquete ICMP de error */
+/* Busca la entrada de la tabla con el prefijo más largo que contiene a dest_ip */
 struct sr_rt *sr_longest_prefix_match(struct sr_instance *sr, uint32_t dest_ip)
 {
-  if (sr == NULL || sr->routing_table == NULL)
-  {
-    printf("SR O SR->RT ES NULL \n");
-    return NULL;
-  }
-  struct sr_rt *longestMatch = NULL;
-  uint32_t bestMask = 0; /* Inicializa la mejor máscara a 0 para buscar la coincidencia más larga */
-  struct sr_rt *tabla = sr->routing_table;
+  struct sr_fib *fib;
 
-  while (tabla != NULL)
+  if (sr == NULL)
   {
-    /* Aplicar la máscara de red al destino IP y comparar con el prefijo de la entrada */
-    uint32_t maskedDest = tabla->mask.s_addr & dest_ip;
-    if (maskedDest == (tabla->dest.s_addr & tabla->mask.s_addr))
-    {
-      /* Si hay coincidencia, verifica si es la coincidencia más larga */
-      if (ntohl(tabla->mask.s_addr) > ntohl(bestMask))
-      {
-        longestMatch = tabla;
-        bestMask = tabla->mask.s_addr;
-      }
-    }
-
-    /* Ir a la siguiente entrada en la tabla de enrutamiento */
-    tabla = tabla->next;
+    printf("SR ES NULL \n");
+    return NULL;
   }
 
-  return longestMatch;
+  /* La entrada devuelta es de la FIB publicada; el llamador debe estar
+     dentro de una sección sr_rcu_read_lock mientras la use */
+  fib = sr_rcu_dereference(sr->fib);
+  return sr_fib_lookup(fib, dest_ip);
 }
 
-/* Envía un paquete ICMP de error */
+/* Envía un paquete ICMP de error; nextMtu sólo para tipo 3 código 4 */
 void sr_send_icmp_error_packet(uint8_t type,
                                uint8_t code,
                                struct sr_instance *sr,
                                uint32_t ipDst,
-                               uint8_t *ipPacket)
+                               uint8_t *ipPacket,
+                               uint16_t nextMtu)
 {
-  print_addr_ip_int(ntohl(ipDst));
-  sr_print_routing_table(sr);
-  struct sr_if *Dest;
-  Dest = sr_get_interface_given_ip(sr , ipDst);
-  
-  if (Dest != NULL){
-    printf("Es para mi el ICMP \n");
+  /* Nunca se manda un error a una dirección propia, ni a un broadcast */
+  if (sr_local_lookup(sr, ipDst, NULL) != SR_LOCAL_NONE){
     return;
   }
 
@@ -117,19 +104,26 @@ void sr_send_icmp_error_packet(uint8_t type,
     struct sr_rt *rtEntry = sr_longest_prefix_match(sr, ipDst);
     if (rtEntry == NULL)
     {
-      printf("No hay entrada en routing table.\n");
+      sr_log_event(IP, SR_LOG_DEBUG, SR_EV_ICMP_UNROUTABLE, ipDst, 0);
       return;
     }
 
     uint32_t next_hop_ip = (rtEntry->gw.s_addr == 0) ? ipDst : rtEntry->gw.s_addr;
 
-    struct sr_if *out_iface = sr_get_interface(sr, rtEntry->interface);
+    struct sr_if *out_iface = sr_get_interface_by_index(sr, rtEntry->ifindex);
 
     if (out_iface == NULL)
     {
-      printf("Interfaz de salida no encontrada para %s\n", rtEntry->interface);
+      sr_log(IP, SR_LOG_WARN, "Interfaz de salida no encontrada para %s\n", rtEntry->interface);
       return;
     }
+
+    /* Límite de tasa: se decide antes de reservar memoria para el error */
+    if (!sr_icmp_limit_allow(&(sr->icmp_limit), rtEntry->ifindex, ipDst))
+    {
+      return;
+    }
+
     char *iface_name = out_iface->name;
 
     /* Determinar el tamaño del paquete ICMP en función del tipo */
@@ -165,33 +159,33 @@ void sr_send_icmp_error_packet(uint8_t type,
     icmpHdr->icmp_code = code;
     icmpHdr->icmp_sum = 0;
     icmpHdr->unused = 0;
-    icmpHdr->next_mtu = 0;
+    icmpHdr->next_mtu = htons(nextMtu);
     memcpy(icmpHdr->data, ipPacket, ICMP_DATA_SIZE);
     icmpHdr->icmp_sum = icmp3_cksum(icmpHdr, sizeof(sr_icmp_t3_hdr_t));
+    sr_log_event(IP, SR_LOG_DEBUG, SR_EV_ICMP_ERROR, (uint32_t)type << 8 | code, ipDst);
 
-    struct sr_arpentry *arpEntry = sr_arpcache_lookup(&(sr->cache), next_hop_ip);
+    struct sr_arpentry arpEntry;
+    int resolved = sr_arpcache_lookup(&(sr->cache), next_hop_ip, &arpEntry);
 
-    if (arpEntry)
+    if (resolved)
     {
       /* Si la entrada existe, usar la dirección MAC de arpEntry */
       memcpy(ethHdr->ether_shost, out_iface->addr, ETHER_ADDR_LEN);
-      memcpy(ethHdr->ether_dhost, arpEntry->mac, ETHER_ADDR_LEN);
-      is_packet_valid(echoReply, len);
-      printf("Paquete a Enviar: \n");
-      print_hdrs(echoReply, len);
+      memcpy(ethHdr->ether_dhost, arpEntry.mac, ETHER_ADDR_LEN);
+      sr_log_dump(IP, echoReply, len);
       sr_send_packet(sr, echoReply, len, out_iface->name);
-      /* Liberar la entrada ARP obtenida */
-      free(arpEntry);
     }
     else
     {
       /* Si no hay entrada ARP, encolar la solicitud ARP*/
-      struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop_ip, echoReply, len, out_iface->name);
+      pthread_mutex_lock(&(sr->cache.lock));
+      struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop_ip, echoReply, len, out_iface->ifindex);
       handle_arpreq(sr, req); /* Maneja la solicitud ARP, enviará el ARP request si es necesario */
+      pthread_mutex_unlock(&(sr->cache.lock));
     }
 
     /* Liberar memoria del paquete solo si no se puso en cola */
-    if (arpEntry)
+    if (resolved)
     {
       free(echoReply);
     }
@@ -199,47 +193,68 @@ void sr_send_icmp_error_packet(uint8_t type,
 
 } /* -- sr_send_icmp_error_packet -- */
 
+/* Envía una trama reenviada. Si está en un buffer del pool (pb no nulo)
+   y hay colas de salida, el buffer se entrega a la cola sin copiar la
+   trama y deja de ser de quien llama (*pb queda en NULL) */
+static void sr_forward_send(struct sr_instance *sr,
+                            uint8_t *packet,
+                            unsigned int len,
+                            unsigned int ifindex,
+                            struct sr_pktbuf **pb)
+{
+  if (sr->egress != NULL && pb != NULL && *pb != NULL)
+  {
+    sr_send_pktbuf(sr, *pb, len, ifindex);
+    *pb = NULL;
+  }
+  else
+  {
+    sr_send_packet_inplace(sr, packet, len, ifindex);
+  }
+}
+
+/* pb es el buffer del pool en que llegó packet, o NULL si no vino en uno */
 void sr_handle_ip_packet(struct sr_instance *sr,
                          uint8_t *packet /* lent */,
                          unsigned int len,
                          uint8_t *srcAddr,
                          uint8_t *destAddr,
                          char *interface /* lent */,
-                         sr_ethernet_hdr_t *eHdr)
+                         sr_ethernet_hdr_t *eHdr,
+                         const struct sr_pkt_meta *meta,
+                         struct sr_pktbuf **pb)
 {
   /*Obtener el cabezal IP y direcciones*/
   sr_ip_hdr_t *ipHdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
-  printf("Paquete recibido: \n");
-  print_hdrs(packet, len);
+  sr_log_dump(IP, packet, len);
 
   /* Obtengo las direcciones IP */
   uint32_t senderIP = ipHdr->ip_src;
   uint32_t targetIP = ipHdr->ip_dst;
 
-  /* Verifico si el paquete IP es para una de mis interfaces */
-  struct sr_if *myInterface = sr_get_interface_given_ip(sr, targetIP);
-  if (myInterface != 0)
+  /* sr_parse_packet ya clasificó el destino y, si es para una de mis
+     interfaces, validó el ICMP u OSPF completo */
+  int localKind = meta->local;
+  if (localKind == SR_LOCAL_IFACE)
   {
     /* Es un paquete para el router: manejar ICMP echo request */
     if (ipHdr->ip_p == ip_protocol_icmp)
     {
-      sr_icmp_hdr_t *icmpHdr = (sr_icmp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+      sr_icmp_hdr_t *icmpHdr = (sr_icmp_hdr_t *)(packet + meta->l4_off);
       if (icmpHdr->icmp_type == 8)
       { /* Echo request */
-        printf("Es Echo request. \n");
         /*Ajustamos el ICMP*/
         icmpHdr->icmp_type = 0;
         icmpHdr->icmp_code = 0;
         icmpHdr->icmp_sum = 0;
-        int icmpLength = len - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t);
-        icmpHdr->icmp_sum = icmp_cksum(icmpHdr, icmpLength);
+        icmpHdr->icmp_sum = icmp_cksum(icmpHdr, meta->l4_len);
 
         /*Ajustamos el IP*/
         ipHdr->ip_src = targetIP;
         ipHdr->ip_dst = senderIP;
         ipHdr->ip_ttl = 64;
         ipHdr->ip_sum = 0;
-        ipHdr->ip_sum = ip_cksum(ipHdr, sizeof(sr_ip_hdr_t));
+        ipHdr->ip_sum = ip_cksum(ipHdr, meta->l4_off - meta->l3_off);
 
         /*Ajustamos el Ethernet*/
         uint8_t auxEtherDest[ETHER_ADDR_LEN];
@@ -247,8 +262,8 @@ void sr_handle_ip_packet(struct sr_instance *sr,
         memcpy(eHdr->ether_dhost, eHdr->ether_shost, ETHER_ADDR_LEN);
         memcpy(eHdr->ether_shost, auxEtherDest, ETHER_ADDR_LEN);
 
-        printf("Mando echo reply \n");
-        print_hdrs(packet, len);
+        sr_log_event(IP, SR_LOG_DEBUG, SR_EV_ECHO_REPLY, senderIP, 0);
+        sr_log_dump(IP, packet, len);
         sr_send_packet(sr, packet, len, interface);
       }
     }
@@ -260,103 +275,159 @@ void sr_handle_ip_packet(struct sr_instance *sr,
     else
     {
       /* Paquete UDP o TCP, responder con ICMP port unreachable */
-      sr_send_icmp_error_packet(3, 3, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t));
+      sr_send_icmp_error_packet(3, 3, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t), 0);
     }
     return;
   }
 
   if (ipHdr->ip_p == ip_protocol_ospfv2)
   {
-    printf("ENTRA AL IF DE PROTOCOLO OSPFV2 \n");
-    if ((ipHdr->ip_dst == ntohl(OSPF_AllSPFRouters)) && (memcmp(eHdr->ether_dhost, sr_multicast_mac, ETHER_ADDR_LEN) == 0))
-    { 
-      printf("ENTRA AL IF DE MULTICAST \n");
+    if (meta->for_us)
+    {
       struct sr_if *iface = sr_get_interface(sr, interface);
       sr_handle_pwospf_packet(sr, packet, len, iface); /*revisar ultimo parametro*/
       return;
     }
   }
 
-  /* Si no es para este router, disminuir TTL y reenviar */
-  ipHdr->ip_ttl--;
-
-   if (ipHdr->ip_ttl < 1)
+  /* El broadcast de una subred conectada no se reenvía */
+  if (localKind == SR_LOCAL_BCAST)
   {
-    /* Enviar ICMP time exceeded */
-    sr_send_icmp_error_packet(11, 0, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t));
+    sr_log_event(IP, SR_LOG_DEBUG, SR_EV_DROP, SR_DROP_BROADCAST, targetIP);
+    sr_count_drop(SR_DROP_BROADCAST);
     return;
   }
 
-  struct sr_rt *rtEntry = sr_longest_prefix_match(sr, ipHdr->ip_dst);
-  printf("Longest prefix match: \n");
-  if (rtEntry)
-  {
-    sr_print_routing_entry(rtEntry);
-  }
-  else
+  /* Si no es para este router, disminuir TTL y reenviar */
+  if (ipHdr->ip_ttl <= 1)
   {
-    printf("Entrada no encontrada \n");
-    /* No hay coincidencia en la tabla de enrutamiento, enviar ICMP net unreachable */
-    sr_send_icmp_error_packet(3, 0, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t));
+    /* Enviar ICMP time exceeded */
+    sr_log_event(IP, SR_LOG_DEBUG, SR_EV_DROP, SR_DROP_TTL, targetIP);
+    sr_count_drop(SR_DROP_TTL);
+    sr_send_icmp_error_packet(11, 0, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t), 0);
     return;
   }
 
+  /* Destino frecuente: la adyacencia sale de la caché en un solo acceso */
+  struct sr_fib *fib = sr_rcu_dereference(sr->fib);
+  struct sr_adj *adj = sr_dstcache_lookup(fib, ipHdr->ip_dst);
+  struct sr_if *out_iface;
   uint32_t next_hop_ip;
-  if (rtEntry->gw.s_addr == 0)
+
+  if (adj == NULL)
   {
-    next_hop_ip = targetIP;
-    printf("Dirección IP de destino en el paquete: ");
-    print_addr_ip_int(next_hop_ip);
+    struct sr_rt *rtEntry = sr_fib_lookup(fib, ipHdr->ip_dst);
+    if (rtEntry == NULL)
+    {
+      /* No hay coincidencia en la tabla de enrutamiento, enviar ICMP net unreachable */
+      sr_log_event(IP, SR_LOG_DEBUG, SR_EV_DROP, SR_DROP_NO_ROUTE, targetIP);
+      sr_count_drop(SR_DROP_NO_ROUTE);
+      sr_send_icmp_error_packet(3, 0, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t), 0);
+      return;
+    }
+
+    /* Varios caminos de igual costo: el flujo elige uno y el destino no
+       se guarda en la caché, que no distingue flujos */
+    int multipath = (rtEntry->nh_count > 1);
+    if (multipath)
+    {
+      rtEntry = sr_fib_select(rtEntry, ip_flow_hash(ipHdr, len - sizeof(sr_ethernet_hdr_t), SR_FIB_ECMP_SEED));
+    }
+
+    if (rtEntry->ifindex == SR_IFINDEX_NONE)
+    {
+      sr_log(IP, SR_LOG_WARN, "Error: No se encontró la interfaz %s\n", rtEntry->interface);
+      return;
+    }
+
+    /* Las rutas con gateway ya traen su adyacencia; en las conectadas el
+       vecino es el propio destino */
+    adj = rtEntry->adj;
+    if (adj == NULL && rtEntry->gw.s_addr == 0)
+    {
+      adj = sr_adj_get(&(sr->adj), targetIP, sr_get_interface_by_index(sr, rtEntry->ifindex));
+    }
+
+    if (adj != NULL)
+    {
+      if (!multipath)
+      {
+        sr_dstcache_fill(fib, ipHdr->ip_dst, adj);
+      }
+      out_iface = sr_get_interface_by_index(sr, adj->ifindex);
+      next_hop_ip = adj->ip;
+    }
+    else
+    {
+      /* Tabla de adyacencias llena: se resuelve con la caché ARP */
+      out_iface = sr_get_interface_by_index(sr, rtEntry->ifindex);
+      next_hop_ip = (rtEntry->gw.s_addr == 0) ? targetIP : rtEntry->gw.s_addr;
+    }
   }
   else
   {
-    next_hop_ip = rtEntry->gw.s_addr;
-    printf("Gateway en la entrada de la tabla de enrutamiento: ");
-    print_addr_ip_int(rtEntry->gw.s_addr);
+    out_iface = sr_get_interface_by_index(sr, adj->ifindex);
+    next_hop_ip = adj->ip;
   }
 
-  sr_icmp_hdr_t *icmpHdr = (sr_icmp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
-  /* Actualizar suma de comprobación del paquete */
-  ipHdr->ip_sum = 0;
-  ipHdr->ip_sum = ip_cksum(ipHdr, sizeof(struct sr_ip_hdr));
-
-  struct sr_if *out_iface = sr_get_interface(sr, rtEntry->interface);
-  if (out_iface == NULL)
+  /* No entra en la interfaz de salida: con DF se avisa al origen el MTU
+     a usar, citando el cabezal como llegó; sin DF se fragmenta al enviar */
+  int fragment = sr_frag_needed(ipHdr, out_iface);
+  if (fragment && (ntohs(ipHdr->ip_off) & IP_DF))
   {
-    printf("Error: No se encontró la interfaz %s\n", rtEntry->interface);
+    sr_log_event(IP, SR_LOG_DEBUG, SR_EV_DROP, SR_DROP_MTU, targetIP);
+    sr_count_drop(SR_DROP_MTU);
+    sr_send_icmp_error_packet(3, 4, sr, ipHdr->ip_src, packet + sizeof(sr_ethernet_hdr_t), out_iface->mtu);
     return;
   }
 
-  char *iface_name = out_iface->name;
-  printf("Iface name: %s\n", iface_name);
+  /* sr_parse_packet ya verificó la suma; sólo se ajusta por el cambio de TTL */
+  ip_decrement_ttl(ipHdr);
 
-  struct sr_arpentry *arpEntry = sr_arpcache_lookup(&(sr->cache), next_hop_ip);
-  if (arpEntry)
+  /* Vecino resuelto: una sola copia del cabezal Ethernet armado */
+  if (adj != NULL && (sr_adj_write_hdr(adj, packet) || (sr_arpcache_fill_adj(sr, adj) && sr_adj_write_hdr(adj, packet))))
+  {
+    sr_log_event(IP, SR_LOG_TRACE, SR_EV_FORWARD, targetIP, out_iface->ifindex);
+    if (fragment)
+    {
+      sr_ip_fragment(sr, packet, len, out_iface->ifindex);
+    }
+    else
+    {
+      sr_forward_send(sr, packet, len, out_iface->ifindex, pb);
+    }
+    sr_count_forwarded(1);
+    return;
+  }
+
+  struct sr_arpentry arpEntry;
+  if (adj == NULL && sr_arpcache_lookup(&(sr->cache), next_hop_ip, &arpEntry))
   {
     /* Si la entrada existe, usar la dirección MAC de arpEntry */
     sr_ethernet_hdr_t *ethHdr = (sr_ethernet_hdr_t *)packet;
-    memcpy(ethHdr->ether_dhost, arpEntry->mac, ETHER_ADDR_LEN);
-
-    struct sr_if *out_interface = sr_get_interface(sr, out_iface);
-    memcpy(ethHdr->ether_shost, out_interface->addr, ETHER_ADDR_LEN); /* Origen: MAC de la interfaz de salida */
+    memcpy(ethHdr->ether_dhost, arpEntry.mac, ETHER_ADDR_LEN);
+    memcpy(ethHdr->ether_shost, out_iface->addr, ETHER_ADDR_LEN); /* Origen: MAC de la interfaz de salida */
 
     /* Enviar el paquete a través de la interfaz de salida */
-    sr_send_packet(sr, packet, len, iface_name);
-
-    /* Liberar la entrada ARP obtenida */
-    free(arpEntry);
+    sr_log_event(IP, SR_LOG_TRACE, SR_EV_FORWARD, targetIP, out_iface->ifindex);
+    if (fragment)
+    {
+      sr_ip_fragment(sr, packet, len, out_iface->ifindex);
+    }
+    else
+    {
+      sr_forward_send(sr, packet, len, out_iface->ifindex, pb);
+    }
+    sr_count_forwarded(1);
   }
   else
   {
-    /* Si no hay entrada ARP, encolar la solicitud ARP
-    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop.s_addr, packet, len, out_iface); */
-    printf("NO ESTA EN CACHE \n");
-    printf("Direccion IP proximo salto: ");
-    print_addr_ip_int(next_hop_ip);
-    printf("Interfaz: ");
-    printf("%s\n", iface_name);
-    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop_ip, packet, len, iface_name);
+    /* Si no hay entrada ARP, encolar la solicitud ARP */
+    sr_log_event(IP, SR_LOG_DEBUG, SR_EV_ARP_QUEUE, next_hop_ip, out_iface->ifindex);
+    pthread_mutex_lock(&(sr->cache.lock));
+    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), next_hop_ip, packet, len, out_iface->ifindex);
     handle_arpreq(sr, req); /* Maneja la solicitud ARP, enviará el ARP request si es necesario */
+    pthread_mutex_unlock(&(sr->cache.lock));
   }
 }
 
@@ -364,31 +435,74 @@ void sr_handle_ip_packet(struct sr_instance *sr,
  * ***** A partir de aquí no debería tener que modificar nada ****
  */
 
-/* Envía todos los paquetes IP pendientes de una solicitud ARP */
+/* Envía todos los paquetes IP pendientes de una solicitud ARP con el
+   cabezal del vecino mac por iface */
 void sr_arp_reply_send_pending_packets(struct sr_instance *sr,
                                        struct sr_arpreq *arpReq,
-                                       uint8_t *dhost,
-                                       uint8_t *shost,
-                                       struct sr_if *iface)
+                                       struct sr_if *iface,
+                                       unsigned char *mac)
 {
 
-  struct sr_packet *currPacket = arpReq->packets;
-  sr_ethernet_hdr_t *ethHdr;
-  uint8_t *copyPacket;
+  struct sr_packet *currPacket;
+  uint8_t l2[sizeof(sr_ethernet_hdr_t)];
+  sr_ethernet_hdr_t *ethHdr = (sr_ethernet_hdr_t *)l2;
+
+  /* El cabezal se arma una vez para todos los paquetes */
+  memcpy(ethHdr->ether_dhost, mac, ETHER_ADDR_LEN);
+  memcpy(ethHdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+  ethHdr->ether_type = htons(ethertype_ip);
 
-  while (currPacket != NULL)
+  /* En orden de llegada; CoDel puede descartar o marcar los que esperaron
+     demasiado */
+  while (arpReq->packets != NULL)
   {
-    ethHdr = (sr_ethernet_hdr_t *)currPacket->buf;
-    memcpy(ethHdr->ether_shost, dhost, sizeof(uint8_t) * ETHER_ADDR_LEN);
-    memcpy(ethHdr->ether_dhost, shost, sizeof(uint8_t) * ETHER_ADDR_LEN);
+    currPacket = sr_arpreq_pop(&(sr->cache), arpReq);
+    if (currPacket == NULL)
+    {
+      continue;
+    }
+
+    memcpy(currPacket->buf, l2, sizeof(l2));
 
-    copyPacket = malloc(sizeof(uint8_t) * currPacket->len);
-    memcpy(copyPacket, ethHdr, sizeof(uint8_t) * currPacket->len);
+    sr_log_dump(ARP, currPacket->buf, currPacket->len);
+    sr_ip_hdr_t *ipHdr = (sr_ip_hdr_t *)(currPacket->buf + sizeof(sr_ethernet_hdr_t));
+    if (sr_frag_needed(ipHdr, iface))
+    {
+      sr_ip_fragment(sr, currPacket->buf, currPacket->len, iface->ifindex);
+    }
+    else
+    {
+      sr_send_packet(sr, currPacket->buf, currPacket->len, iface->name);
+    }
+    sr_count_forwarded(1);
+    free(currPacket->buf);
+    free(currPacket);
+  }
+}
 
-    print_hdrs(copyPacket, currPacket->len);
-    sr_send_packet(sr, copyPacket, currPacket->len, iface->name);
-    currPacket = currPacket->next;
+/* Aprende el mapeo IP->MAC del emisor de un ARP recibido por iface y
+   envía los paquetes que esperaban esa resolución en iface */
+static void sr_arp_learn_sender(struct sr_instance *sr,
+                                uint32_t senderIP,
+                                unsigned char *senderHardAddr,
+                                struct sr_if *iface)
+{
+  /* Con el lock de la caché tomado ningún otro hilo encola en arpReq ni
+     lo destruye mientras se envían sus paquetes */
+  pthread_mutex_lock(&(sr->cache.lock));
+  struct sr_arpreq *arpReq = sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP, iface->ifindex);
+
+  /* Todas las rutas que usan a este vecino por iface quedan resueltas de
+     una vez; los paquetes pendientes no dependen de que haya adyacencia */
+  sr_adj_resolve(&(sr->adj), senderIP, iface->ifindex, senderHardAddr);
+  sr_log_event(ARP, SR_LOG_INFO, SR_EV_ARP_LEARN, senderIP, arpReq != NULL);
+
+  if (arpReq != NULL)
+  { /* Si hay paquetes pendientes */
+    sr_arp_reply_send_pending_packets(sr, arpReq, iface, senderHardAddr);
+    sr_arpreq_destroy(&(sr->cache), arpReq);
   }
+  pthread_mutex_unlock(&(sr->cache.lock));
 }
 
 /* Gestiona la llegada de un paquete ARP*/
@@ -401,9 +515,8 @@ void sr_handle_arp_packet(struct sr_instance *sr,
                           sr_ethernet_hdr_t *eHdr)
 {
 
-  /* Imprimo el cabezal ARP */
-  printf("*** -> It is an ARP packet. Print ARP header.\n");
-  print_hdr_arp(packet + sizeof(sr_ethernet_hdr_t));
+  /* Imprimo los cabezales, sólo en el nivel de depuración más alto */
+  sr_log_dump(ARP, packet, len);
 
   /* Obtengo el cabezal ARP */
   sr_arp_hdr_t *arpHdr = (sr_arp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
@@ -421,21 +534,23 @@ void sr_handle_arp_packet(struct sr_instance *sr,
   /* Verifico si el paquete ARP es para una de mis interfaces */
   struct sr_if *myInterface = sr_get_interface_given_ip(sr, targetIP);
 
+  /* Interfaz de llegada: las solicitudes pendientes son por interfaz */
+  struct sr_if *inIface = sr_get_interface(sr, interface);
+  if (inIface == 0)
+  {
+    return;
+  }
+
   if (op == arp_op_request)
   { /* Si es un request ARP */
-    printf("**** -> It is an ARP request.\n");
 
     /* Si el ARP request es para una de mis interfaces */
     if (myInterface != 0)
     {
-      printf("***** -> ARP request is for one of my interfaces.\n");
-
       /* Agrego el mapeo MAC->IP del sender a mi caché ARP */
-      printf("****** -> Add MAC->IP mapping of sender to my ARP cache.\n");
-      sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
+      sr_arp_learn_sender(sr, senderIP, senderHardAddr, inIface);
 
       /* Construyo un ARP reply y lo envío de vuelta */
-      printf("****** -> Construct an ARP reply and send it back.\n");
       memcpy(eHdr->ether_shost, (uint8_t *)myInterface->addr, sizeof(uint8_t) * ETHER_ADDR_LEN);
       memcpy(eHdr->ether_dhost, (uint8_t *)senderHardAddr, sizeof(uint8_t) * ETHER_ADDR_LEN);
       memcpy(arpHdr->ar_sha, myInterface->addr, ETHER_ADDR_LEN);
@@ -444,31 +559,17 @@ void sr_handle_arp_packet(struct sr_instance *sr,
       arpHdr->ar_tip = senderIP;
       arpHdr->ar_op = htons(arp_op_reply);
 
-      /* Imprimo el cabezal del ARP reply creado */
-      print_hdrs(packet, len);
+      sr_log_event(ARP, SR_LOG_INFO, SR_EV_ARP_REPLY, senderIP, myInterface->ifindex);
+      sr_log_dump(ARP, packet, len);
 
       sr_send_packet(sr, packet, len, myInterface->name);
     }
-
-    printf("******* -> ARP request processing complete.\n");
   }
   else if (op == arp_op_reply)
   { /* Si es un reply ARP */
 
-    printf("**** -> It is an ARP reply.\n");
-
     /* Agrego el mapeo MAC->IP del sender a mi caché ARP */
-    printf("***** -> Add MAC->IP mapping of sender to my ARP cache.\n");
-    struct sr_arpreq *arpReq = sr_arpcache_insert(&(sr->cache), senderHardAddr, senderIP);
-
-    if (arpReq != NULL)
-    { /* Si hay paquetes pendientes */
-
-      printf("****** -> Send outstanding packets.\n");
-      sr_arp_reply_send_pending_packets(sr, arpReq, (uint8_t *)myInterface->addr, (uint8_t *)senderHardAddr, myInterface);
-      sr_arpreq_destroy(&(sr->cache), arpReq);
-    }
-    printf("******* -> ARP reply processing complete.\n");
+    sr_arp_learn_sender(sr, senderIP, senderHardAddr, inIface);
   }
 }
 
@@ -484,39 +585,44 @@ void sr_handle_arp_packet(struct sr_instance *sr,
  * Note: Both the packet buffer and the character's memory are handled
  * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
  * packet instead if you intend to keep it around beyond the scope of
- * the method call.
+ * the method call. The exception is pb, the pool buffer holding the
+ * packet: forwarding may hand it to an output queue and set *pb to NULL.
  *
  *---------------------------------------------------------------------*/
 
 void sr_handlepacket(struct sr_instance *sr,
                      uint8_t *packet /* lent */,
                      unsigned int len,
-                     char *interface /* lent */)
+                     char *interface /* lent */,
+                     struct sr_pktbuf **pb)
 {
   assert(sr);
   assert(packet);
   assert(interface);
 
-  printf("*** -> Received packet of length %d \n", len);
-
   /* Obtengo direcciones MAC origen y destino */
   sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *)packet;
-  uint8_t *destAddr = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
-  uint8_t *srcAddr = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
+  uint8_t destAddr[ETHER_ADDR_LEN];
+  uint8_t srcAddr[ETHER_ADDR_LEN];
   memcpy(destAddr, eHdr->ether_dhost, sizeof(uint8_t) * ETHER_ADDR_LEN);
   memcpy(srcAddr, eHdr->ether_shost, sizeof(uint8_t) * ETHER_ADDR_LEN);
-  uint16_t pktType = ntohs(eHdr->ether_type);
+  struct sr_pkt_meta meta;
 
-  if (is_packet_valid(packet, len))
+  /* Se analiza una sola vez; las etapas siguientes usan meta */
+  if (sr_parse_packet(sr, packet, len, &meta))
   {
-    if (pktType == ethertype_arp)
+    if (meta.ethertype == ethertype_arp)
     {
       sr_handle_arp_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr);
     }
-    else if (pktType == ethertype_ip)
+    else if (meta.ethertype == ethertype_ip)
     {
-      sr_handle_ip_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr);
+      sr_handle_ip_packet(sr, packet, len, srcAddr, destAddr, interface, eHdr, &meta, pb);
     }
   }
+  else
+  {
+    sr_count_drop(SR_DROP_INVALID);
+  }
 
 } /* end sr_ForwardPacket */
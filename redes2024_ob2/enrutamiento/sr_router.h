@@ -15,24 +15,32 @@
 
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_fib.h"
+#include "sr_adj.h"
+#include "sr_local.h"
+#include "sr_icmplimit.h"
+#include "sr_parse.h"
+#include "sr_log.h"
 
-/* we dont like this debug , but what to do for varargs ? */
-#ifdef _DEBUG_
-#define Debug(x, args...) printf(x, ## args)
+/* Debug is control-plane logging at SR_LOG_DEBUG, see sr_log.h */
+#define Debug(x, args...) sr_log(CTRL, SR_LOG_DEBUG, x, ## args)
 #define DebugMAC(x) \
-  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
-  (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
-#else
-#define Debug(x, args...) do{}while(0)
-#define DebugMAC(x) do{}while(0)
-#endif
+  do { int ivyl; if (sr_log_enabled(CTRL, SR_LOG_DEBUG)) { \
+  for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", (unsigned char)(x[ivyl])); \
+  printf("%02x",(unsigned char)(x[5])); } } while (0)
 
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
+#define SR_SEND_IOV_MAX 4 /* pieces of a frame for sr_send_packetv */
 
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_worker;
+struct sr_slowpath;
+struct iovec;
+struct sr_pktbuf;
+struct sr_egress;
 
 struct pwospf_subsys;
 
@@ -52,10 +60,27 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_if* if_table[SR_IF_MAX]; /* interfaces by ifindex */
+    unsigned int num_ifs;
+    uint8_t if_hash[SR_IF_HASH]; /* name hash, ifindex + 1 or 0 if empty */
+    struct sr_local_table local; /* addresses owned by the router */
     struct sr_rt* routing_table; /* routing table */
+    struct sr_fib* fib; /* published forwarding table, see sr_publish_fib */
+    int fib_dir24; /* build the DIR-24-8 table in each FIB */
     struct sr_arpcache cache;   /* ARP cache */
+    struct sr_adj_table adj;    /* neighbors with prebuilt ethernet headers */
+    struct sr_icmp_limit icmp_limit; /* ICMP error rate limits */
+    const char* if_mtus; /* -m iface:mtu list, applied when interfaces arrive */
+    unsigned int arp_size; /* neighbors the ARP cache holds (-a) */
     pthread_attr_t attr;
     FILE* logfile;
+    pthread_mutex_t send_lock;  /* serializes writes to sockfd and logfile */
+
+    /* -- forwarding workers, see sr_worker.h -- */
+    struct sr_worker* workers;
+    unsigned int num_workers;   /* 0: frames are handled by the reader */
+    struct sr_slowpath* slowpath; /* exceptions punted by the workers, see sr_slowpath.h */
+    struct sr_egress* egress;   /* output queues, NULL to write right away, see sr_egress.h */
 
     /* -- pwospf subsystem -- */
     struct pwospf_subsys* ospf_subsys;
@@ -66,15 +91,19 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_inplace(struct sr_instance* , uint8_t* , unsigned int , unsigned int);
+int sr_send_packetv(struct sr_instance* , const struct iovec* , int , unsigned int);
+int sr_send_pktbuf(struct sr_instance* , struct sr_pktbuf* , unsigned int , unsigned int);
+int sr_write_frames(struct sr_instance* , uint8_t* const* , const unsigned int* , unsigned int , unsigned int);
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
-void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* , struct sr_pktbuf** );
 void sr_handle_arp_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *);
-void sr_handle_ip_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *);
-void sr_send_icmp_error_packet(uint8_t, uint8_t, struct sr_instance*, uint32_t, uint8_t*);
+void sr_handle_ip_packet(struct sr_instance*, uint8_t *, unsigned int, uint8_t *, uint8_t *, char *, sr_ethernet_hdr_t *, const struct sr_pkt_meta *, struct sr_pktbuf **);
+void sr_send_icmp_error_packet(uint8_t, uint8_t, struct sr_instance*, uint32_t, uint8_t*, uint16_t);
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 
 
 #include <sys/socket.h>
@@ -21,6 +22,12 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_fib.h"
+#include "sr_rcu.h"
+
+/* -- serializa la publicación de versiones de la FIB -- */
+static pthread_mutex_t fib_publish_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long fib_generation = 0;
 
 /*---------------------------------------------------------------------
  * Method:
@@ -82,6 +89,8 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface, 0);
     } /* -- while -- */
 
+    sr_publish_fib(sr);
+
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
@@ -256,6 +265,62 @@ void sr_del_rt_entry(struct sr_rt* previous_entry)
     free(temp);
 } /* -- sr_del_rt_entry -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_publish_fib
+ *
+ * Construye una FIB nueva a partir de sr->routing_table y la publica en
+ * sr->fib; su tabla DIR-24-8, si la hay, se deriva de la de la versión
+ * actual. La versión anterior se libera, y suelta sus adyacencias,
+ * cuando ya no hay lectores que puedan estar usándola. Se llama una vez
+ * terminado cada cambio de la tabla, no por cada entrada.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_publish_fib(struct sr_instance* sr)
+{
+    struct sr_fib* fib;
+    struct sr_fib* old;
+    struct sr_rt* route;
+    struct sr_if* iface;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    pthread_mutex_lock(&fib_publish_lock);
+
+    fib = sr_fib_build(sr->routing_table, sr->fib, sr->fib_dir24);
+    fib->generation = ++fib_generation;
+
+    /* Se resuelven interfaz y adyacencia una sola vez por versión */
+    for (i = 0; i < fib->routes_size; i++)
+    {
+        route = &fib->routes[i];
+        iface = sr_get_interface(sr, route->interface);
+        route->ifindex = (iface != NULL) ? iface->ifindex : SR_IFINDEX_NONE;
+        route->adj = NULL;
+        if (iface != NULL && route->gw.s_addr != 0)
+        {
+            route->adj = sr_adj_hold(&(sr->adj), route->gw.s_addr, iface);
+            sr_arpcache_fill_adj(sr, route->adj);
+        }
+    }
+    old = sr->fib;
+    sr_rcu_assign_pointer(sr->fib, fib);
+
+    sr_rcu_synchronize();
+    for (i = 0; i < old->routes_size; i++)
+    {
+        if (old->routes[i].adj != NULL)
+        {
+            sr_adj_release(&(sr->adj), old->routes[i].adj);
+        }
+    }
+    sr_fib_free(old);
+
+    pthread_mutex_unlock(&fib_publish_lock);
+} /* -- sr_publish_fib -- */
+
 /*---------------------------------------------------------------------
  * Method: check_route
  *
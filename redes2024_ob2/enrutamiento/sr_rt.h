@@ -20,6 +20,8 @@
 
 #include "sr_if.h"
 
+struct sr_adj;
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
@@ -38,6 +40,12 @@ struct sr_rt
     /* New Field */
     uint8_t admin_dst;
     /*************/
+
+    /* -- resolved by sr_publish_fib, only set in FIB copies -- */
+    unsigned int ifindex;    /* output interface, SR_IFINDEX_NONE if unknown */
+    struct sr_adj* adj;      /* gateway adjacency, NULL for connected routes */
+    struct sr_rt* nh_next;   /* next equal-cost route to the same prefix */
+    uint8_t nh_count;        /* equal-cost routes, counted on the installed one */
 };
 
 
@@ -51,6 +59,7 @@ void sr_print_routing_entry(struct sr_rt* entry);
 int count_routes(struct sr_instance*);
 void clear_routes(struct sr_instance*);
 void sr_del_rt_entry(struct sr_rt*);
+void sr_publish_fib(struct sr_instance*);
 uint8_t check_route(struct sr_instance*, struct in_addr);
 
 #endif  /* --  sr_RT_H -- */
@@ -0,0 +1,285 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_slowpath.c
+ *
+ * Descripción:
+ *
+ * Hilo del camino lento y colas de derivación, ver sr_slowpath.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_slowpath.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pktbuf.h"
+#include "sr_pwospf.h"
+#include "sr_rcu.h"
+
+/* Vueltas sin trabajo antes de dormirse */
+#define SR_SLOWPATH_SPIN 1024
+
+/* Tramas que se sacan de una cola antes de pasar a la siguiente */
+#define SR_SLOWPATH_BATCH 32
+
+/* Colas del trabajador que corre en este hilo */
+static __thread struct sr_punt_ring* self = 0;
+static __thread struct sr_punt_ring* self_control = 0;
+
+/* Procesa la trama de item; *pb queda en NULL si el reenvío se quedó con
+   el buffer */
+static void sr_slowpath_handle(struct sr_instance* sr, const struct sr_punt_item* item,
+                               struct sr_pktbuf** pb)
+{
+    uint8_t* frame = sr_pktbuf_frame(item->pb);
+    sr_ethernet_hdr_t* eHdr = (sr_ethernet_hdr_t*)frame;
+    struct sr_if* iface = sr->if_table[item->ifindex];
+    uint8_t srcAddr[ETHER_ADDR_LEN], destAddr[ETHER_ADDR_LEN];
+
+    memcpy(destAddr, eHdr->ether_dhost, ETHER_ADDR_LEN);
+    memcpy(srcAddr, eHdr->ether_shost, ETHER_ADDR_LEN);
+
+    sr_rcu_read_lock();
+    switch (item->kind)
+    {
+        case SR_PUNT_ARP:
+            sr_handle_arp_packet(sr, frame, item->len, srcAddr, destAddr, iface->name, eHdr);
+            break;
+        case SR_PUNT_OSPF:
+            sr_handle_pwospf_packet(sr, frame, item->len, iface);
+            break;
+        default:
+            sr_handle_ip_packet(sr, frame, item->len, srcAddr, destAddr, iface->name, eHdr,
+                                &item->meta, pb);
+            break;
+    }
+    sr_rcu_read_unlock();
+}
+
+/* Procesa hasta max tramas de la cola r; devuelve cuántas */
+static unsigned int sr_slowpath_drain(struct sr_slowpath* sp, struct sr_punt_ring* r,
+                                      unsigned int max)
+{
+    struct sr_punt_item* item;
+    struct sr_pktbuf* pb;
+    unsigned int tail = r->tail;
+    unsigned int n = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+    unsigned int done;
+
+    if (n > max)
+    {
+        n = max;
+    }
+
+    for (done = 0; done < n; done++, tail++)
+    {
+        item = &r->ring[tail & (SR_PUNT_RING - 1)];
+        pb = item->pb;
+        sr_slowpath_handle(sp->sr, item, &pb);
+        sp->handled[item->kind]++;
+        if (pb != NULL)
+        {
+            sr_pktbuf_put(pb);
+        }
+        __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    return done;
+}
+
+/* Duerme hasta que algún trabajador derive una trama */
+static void sr_slowpath_wait(struct sr_slowpath* sp)
+{
+    unsigned int i;
+    int empty = 1;
+
+    pthread_mutex_lock(&(sp->lock));
+    __atomic_store_n(&sp->sleeping, 1, __ATOMIC_SEQ_CST);
+    for (;;)
+    {
+        for (i = 0; i < sp->num_rings && empty; i++)
+        {
+            empty = (sp->rings[i].tail == __atomic_load_n(&sp->rings[i].head, __ATOMIC_SEQ_CST)) &&
+                    (sp->control[i].tail == __atomic_load_n(&sp->control[i].head, __ATOMIC_SEQ_CST));
+        }
+        if (!empty)
+        {
+            break;
+        }
+        pthread_cond_wait(&(sp->cond), &(sp->lock));
+    }
+    __atomic_store_n(&sp->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&(sp->lock));
+}
+
+static void* sr_slowpath_run(void* arg)
+{
+    struct sr_slowpath* sp = (struct sr_slowpath*)arg;
+    unsigned int i, done, spins = 0;
+
+    for (;;)
+    {
+        /* El plano de control primero y entero: sus colas sólo reciben
+           ARP y OSPF, que no llegan en ráfagas sostenidas */
+        done = 0;
+        for (i = 0; i < sp->num_rings; i++)
+        {
+            done += sr_slowpath_drain(sp, &sp->control[i], SR_PUNT_RING);
+        }
+
+        /* Las excepciones IP por turnos, para que un trabajador con muchas
+           no postergue las de los demás */
+        for (i = 0; i < sp->num_rings; i++)
+        {
+            done += sr_slowpath_drain(sp, &sp->rings[i], SR_SLOWPATH_BATCH);
+        }
+
+        if (done > 0)
+        {
+            spins = 0;
+        }
+        else if (++spins >= SR_SLOWPATH_SPIN)
+        {
+            sr_slowpath_wait(sp);
+            spins = 0;
+        }
+    }
+
+    return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_slowpath_start
+ *
+ * Crea el hilo del camino lento con una cola por cada uno de los
+ * producers trabajadores
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_slowpath_start(struct sr_instance* sr, unsigned int producers)
+{
+    struct sr_slowpath* sp;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(producers > 0 && producers <= SR_WORKER_MAX);
+
+    sp = (struct sr_slowpath*)calloc(1, sizeof(struct sr_slowpath));
+    assert(sp);
+    sp->sr = sr;
+    sp->num_rings = producers;
+    pthread_mutex_init(&(sp->lock), NULL);
+    pthread_cond_init(&(sp->cond), NULL);
+
+    if (pthread_create(&(sp->thread), &(sr->attr), sr_slowpath_run, sp) != 0)
+    {
+        perror("pthread_create");
+        assert(0);
+    }
+
+    __atomic_store_n(&sr->slowpath, sp, __ATOMIC_RELEASE);
+} /* -- sr_slowpath_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_slowpath_attach
+ *
+ * Asocia el hilo actual a las colas número producer; cada trabajador lo
+ * llama al arrancar
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_slowpath_attach(struct sr_instance* sr, unsigned int producer)
+{
+    /* -- REQUIRES -- */
+    assert(sr && sr->slowpath);
+    assert(producer < sr->slowpath->num_rings);
+
+    self = &sr->slowpath->rings[producer];
+    self_control = &sr->slowpath->control[producer];
+} /* -- sr_slowpath_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_slowpath_punt
+ *
+ * Deriva la trama de pb, con lo que sr_parse_packet dejó en meta, al
+ * camino lento, por la cola de control si es ARP u OSPF. Devuelve 1 si el camino lento se quedó con el buffer, 0
+ * si la cola estaba llena (la trama se cuenta como descartada) o si el
+ * hilo no tiene cola; en ambos casos el buffer sigue siendo de quien
+ * llama.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_slowpath_punt(struct sr_instance* sr, struct sr_pktbuf* pb, unsigned int len,
+                     unsigned int ifindex, const struct sr_pkt_meta* meta,
+                     unsigned int kind)
+{
+    struct sr_slowpath* sp = sr->slowpath;
+    struct sr_punt_ring* r = (kind == SR_PUNT_IP) ? self : self_control;
+    struct sr_punt_item* item;
+    unsigned int head;
+
+    /* -- REQUIRES -- */
+    assert(pb);
+    assert(meta);
+    assert(kind < SR_PUNT_COUNT);
+
+    if (r == 0)
+    {
+        return 0;
+    }
+
+    head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= SR_PUNT_RING)
+    {
+        r->drops++;
+        return 0;
+    }
+
+    item = &r->ring[head & (SR_PUNT_RING - 1)];
+    item->pb = pb;
+    item->len = len;
+    item->ifindex = ifindex;
+    item->kind = kind;
+    item->meta = *meta;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+    r->punted++;
+
+    if (__atomic_load_n(&sp->sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&(sp->lock));
+        pthread_cond_signal(&(sp->cond));
+        pthread_mutex_unlock(&(sp->lock));
+    }
+    return 1;
+} /* -- sr_slowpath_punt -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_slowpath_print_stats
+ *
+ * Imprime las tramas derivadas y descartadas por cada trabajador y las
+ * procesadas por tipo
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_slowpath_print_stats(struct sr_instance* sr)
+{
+    struct sr_slowpath* sp = sr->slowpath;
+    unsigned int i;
+
+    if (sp == 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < sp->num_rings; i++)
+    {
+        printf("Camino lento, trabajador %u: %lu derivadas, %lu descartadas; "
+               "control: %lu derivadas, %lu descartadas\n", i,
+               sp->rings[i].punted, sp->rings[i].drops,
+               sp->control[i].punted, sp->control[i].drops);
+    }
+    printf("Camino lento: %lu ARP, %lu OSPF, %lu IP procesadas\n",
+           sp->handled[SR_PUNT_ARP], sp->handled[SR_PUNT_OSPF], sp->handled[SR_PUNT_IP]);
+} /* -- sr_slowpath_print_stats -- */
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_slowpath.h
+ *
+ * Descripción:
+ *
+ * Camino lento. Con trabajadores (sr_worker.h) el reenvío se separa en
+ * dos niveles: los trabajadores sólo reenvían tráfico unicast con vecino
+ * resuelto, y todo lo demás (ARP, OSPF, paquetes para el router, TTL
+ * vencido, destinos sin ruta o sin resolver) se deriva a un único hilo
+ * de camino lento que lo procesa con el código de sr_router.c. Así una
+ * ráfaga de excepciones, con sus errores ICMP, impresiones y pedidos ARP,
+ * no frena el reenvío.
+ *
+ * Cada trabajador deriva por sus propias colas acotadas de un productor
+ * y un consumidor, y con la cola llena la trama se descarta y se cuenta.
+ * ARP y OSPF van por una cola de control aparte, que el hilo lento
+ * atiende antes que las excepciones IP: una ráfaga de TTL vencidos o de
+ * destinos sin ruta no puede llenarla ni demorarla. La trama viaja en el
+ * mismo buffer en que se leyó (sr_pktbuf.h), que el hilo lento devuelve
+ * al terminar.
+ *
+ * El hilo lento es además el único que procesa el plano de control, de
+ * modo que sigue corriendo en un solo hilo como antes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SLOWPATH_H
+#define SR_SLOWPATH_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#include "sr_worker.h"
+#include "sr_parse.h"
+
+struct sr_instance;
+struct sr_pktbuf;
+
+#define SR_PUNT_RING    128     /* -- potencia de 2 -- */
+
+/* Qué hace el camino lento con la trama */
+enum sr_punt_kind
+{
+    SR_PUNT_ARP,                /* -- sr_handle_arp_packet -- */
+    SR_PUNT_OSPF,               /* -- sr_handle_pwospf_packet -- */
+    SR_PUNT_IP,                 /* -- sr_handle_ip_packet -- */
+    SR_PUNT_COUNT
+};
+
+struct sr_punt_item
+{
+    struct sr_pktbuf* pb;
+    unsigned int len;
+    unsigned int ifindex;       /* -- interfaz de llegada -- */
+    unsigned int kind;
+    struct sr_pkt_meta meta;    /* -- lo analizado por el trabajador -- */
+};
+
+struct sr_punt_ring
+{
+    struct sr_punt_item ring[SR_PUNT_RING];
+    unsigned int head;          /* -- la escribe el trabajador -- */
+    char pad_head[64 - sizeof(unsigned int)];
+    unsigned int tail;          /* -- la escribe el hilo lento -- */
+    char pad_tail[64 - sizeof(unsigned int)];
+    unsigned long punted;       /* -- derivadas por este trabajador -- */
+    unsigned long drops;        /* -- descartadas con la cola llena -- */
+};
+
+struct sr_slowpath
+{
+    struct sr_instance* sr;
+    pthread_t thread;
+    struct sr_punt_ring rings[SR_WORKER_MAX];     /* -- excepciones IP -- */
+    struct sr_punt_ring control[SR_WORKER_MAX];   /* -- ARP y OSPF -- */
+    unsigned int num_rings;
+    int sleeping;               /* -- esperando en cond con las colas vacías -- */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned long handled[SR_PUNT_COUNT];
+};
+
+void sr_slowpath_start(struct sr_instance*, unsigned int producers);
+void sr_slowpath_attach(struct sr_instance*, unsigned int producer);
+int sr_slowpath_punt(struct sr_instance*, struct sr_pktbuf* pb, unsigned int len,
+                     unsigned int ifindex, const struct sr_pkt_meta* meta,
+                     unsigned int kind);
+void sr_slowpath_print_stats(struct sr_instance*);
+
+#endif /* -- SR_SLOWPATH_H -- */
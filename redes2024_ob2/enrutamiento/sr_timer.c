@@ -0,0 +1,242 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Descripción:
+ *
+ * Rueda de temporizadores jerárquica, ver sr_timer.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "sr_timer.h"
+
+#define SR_TIMER_MASK   (SR_TIMER_SLOTS - 1)
+
+/* Ranura del nivel lvl para un vencimiento */
+#define SR_TIMER_INDEX(expires, lvl) \
+    ((unsigned int)((expires) >> ((lvl) * SR_TIMER_BITS)) & SR_TIMER_MASK)
+
+/* Mayor distancia que entra en la rueda */
+#define SR_TIMER_SPAN   ((uint64_t)1 << (SR_TIMER_LEVELS * SR_TIMER_BITS))
+
+static void sr_timer_link(struct sr_timer** head, struct sr_timer* t)
+{
+    t->next = *head;
+    if (t->next != 0)
+    {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+}
+
+static void sr_timer_unlink(struct sr_timer* t)
+{
+    *t->pprev = t->next;
+    if (t->next != 0)
+    {
+        t->next->pprev = t->pprev;
+    }
+    t->next = 0;
+    t->pprev = 0;
+}
+
+/* Ubica t en la ranura de su vencimiento, según cuánto falta */
+static void sr_timer_place(struct sr_timer_wheel* wheel, struct sr_timer* t)
+{
+    uint64_t delta;
+    unsigned int lvl;
+
+    /* Lo vencido sale en el próximo ms */
+    if (t->expires < wheel->now)
+    {
+        t->expires = wheel->now;
+    }
+    delta = t->expires - wheel->now;
+    if (delta >= SR_TIMER_SPAN)
+    {
+        t->expires = wheel->now + SR_TIMER_SPAN - 1;
+        delta = SR_TIMER_SPAN - 1;
+    }
+
+    for (lvl = 0; lvl < SR_TIMER_LEVELS - 1; lvl++)
+    {
+        if (delta < ((uint64_t)1 << ((lvl + 1) * SR_TIMER_BITS)))
+        {
+            break;
+        }
+    }
+    sr_timer_link(&wheel->slot[lvl][SR_TIMER_INDEX(t->expires, lvl)], t);
+}
+
+/* Baja los temporizadores de una ranura del nivel lvl a los de abajo;
+   devuelve la ranura, 0 cuando ese nivel también dio la vuelta */
+static unsigned int sr_timer_cascade(struct sr_timer_wheel* wheel, unsigned int lvl)
+{
+    unsigned int index = SR_TIMER_INDEX(wheel->now, lvl);
+    struct sr_timer* list = wheel->slot[lvl][index];
+    struct sr_timer* t;
+
+    wheel->slot[lvl][index] = 0;
+    while ((t = list) != 0)
+    {
+        list = t->next;
+        t->next = 0;
+        t->pprev = 0;
+        sr_timer_place(wheel, t);
+    }
+    return index;
+}
+
+uint64_t sr_timer_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_wheel_init
+ *
+ * Inicializa una rueda vacía que empieza en now (ms)
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_wheel_init(struct sr_timer_wheel* wheel, uint64_t now)
+{
+    /* -- REQUIRES -- */
+    assert(wheel);
+
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+} /* -- sr_timer_wheel_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_init
+ *
+ * Prepara un temporizador sin armar que al vencer llama a fn
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_init(struct sr_timer* t, void (*fn)(struct sr_timer*, void* ctx))
+{
+    t->expires = 0;
+    t->next = 0;
+    t->pprev = 0;
+    t->fn = fn;
+} /* -- sr_timer_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_add
+ *
+ * Arma t para que venza en expires (ms de sr_timer_now_ms); si ya estaba
+ * armado lo mueve
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_add(struct sr_timer_wheel* wheel, struct sr_timer* t, uint64_t expires)
+{
+    /* -- REQUIRES -- */
+    assert(wheel);
+    assert(t);
+
+    if (sr_timer_pending(t))
+    {
+        sr_timer_unlink(t);
+    }
+    else
+    {
+        wheel->pending++;
+    }
+    t->expires = expires;
+    sr_timer_place(wheel, t);
+} /* -- sr_timer_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_del
+ *
+ * Desarma t; no hace nada si no estaba armado
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_del(struct sr_timer_wheel* wheel, struct sr_timer* t)
+{
+    if (sr_timer_pending(t))
+    {
+        sr_timer_unlink(t);
+        wheel->pending--;
+    }
+} /* -- sr_timer_del -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_moved
+ *
+ * Para quien copia un temporizador armado a otra dirección: engancha la
+ * copia en lugar del original, que deja de usarse
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_moved(struct sr_timer* t)
+{
+    if (sr_timer_pending(t))
+    {
+        *t->pprev = t;
+        if (t->next != 0)
+        {
+            t->next->pprev = &t->next;
+        }
+    }
+} /* -- sr_timer_moved -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_run
+ *
+ * Avanza la rueda hasta now (ms) y llama a fn(t, ctx) por cada
+ * temporizador vencido, ya desarmado. fn puede volver a armarlo y armar,
+ * desarmar o mover otros. Devuelve cuántos vencieron.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_timer_run(struct sr_timer_wheel* wheel, uint64_t now, void* ctx)
+{
+    struct sr_timer* list;
+    struct sr_timer* t;
+    unsigned int index, lvl, fired = 0;
+
+    /* -- REQUIRES -- */
+    assert(wheel);
+
+    while (wheel->now <= now)
+    {
+        index = SR_TIMER_INDEX(wheel->now, 0);
+        for (lvl = 1; index == 0 && lvl < SR_TIMER_LEVELS; lvl++)
+        {
+            index = sr_timer_cascade(wheel, lvl);
+        }
+
+        /* La ranura del ms pasa a una lista local antes de avanzar, así
+           lo que se arme durante las llamadas queda para los próximos */
+        list = 0;
+        t = wheel->slot[0][SR_TIMER_INDEX(wheel->now, 0)];
+        if (t != 0)
+        {
+            wheel->slot[0][SR_TIMER_INDEX(wheel->now, 0)] = 0;
+            list = t;
+            t->pprev = &list;
+        }
+        wheel->now++;
+
+        while ((t = list) != 0)
+        {
+            sr_timer_unlink(t);
+            wheel->pending--;
+            fired++;
+            t->fn(t, ctx);
+        }
+    }
+    return fired;
+} /* -- sr_timer_run -- */
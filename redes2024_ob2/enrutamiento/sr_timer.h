@@ -0,0 +1,64 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Descripción:
+ *
+ * Rueda de temporizadores jerárquica con resolución de milisegundos sobre
+ * CLOCK_MONOTONIC. Agregar, mover o cancelar un temporizador es O(1) y
+ * avanzar la rueda sólo mira la ranura del milisegundo que pasa, así que
+ * el costo no depende de cuántos temporizadores hay.
+ *
+ * Hay SR_TIMER_LEVELS niveles de SR_TIMER_SLOTS ranuras: el nivel 0 tiene
+ * una ranura por milisegundo, el 1 una cada 64 ms, el 2 una cada 4 s y el
+ * 3 una cada 4,4 minutos, hasta unas 4,6 horas; un vencimiento más lejano
+ * se acerca a ese máximo. Cuando el nivel 0 da la vuelta los
+ * temporizadores de la próxima ranura del nivel 1 bajan (cascada) a sus
+ * ranuras del nivel 0, y así con los niveles de arriba.
+ *
+ * Los temporizadores van dentro de la estructura a la que pertenecen
+ * (intrusivos) y la rueda no tiene lock propio: la protege el lock de
+ * quien la usa, que también se tiene al llamar a sr_timer_run.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TIMER_H
+#define SR_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+#define SR_TIMER_BITS       6
+#define SR_TIMER_SLOTS      (1 << SR_TIMER_BITS)
+#define SR_TIMER_LEVELS     4
+
+struct sr_timer
+{
+    uint64_t expires;           /* -- ms de sr_timer_now_ms -- */
+    struct sr_timer* next;
+    struct sr_timer** pprev;    /* -- puntero que apunta a éste, NULL si no está armado -- */
+    void (*fn)(struct sr_timer*, void* ctx);
+};
+
+struct sr_timer_wheel
+{
+    uint64_t now;               /* -- próximo ms a procesar -- */
+    unsigned long pending;
+    struct sr_timer* slot[SR_TIMER_LEVELS][SR_TIMER_SLOTS];
+};
+
+#define sr_timer_pending(t) ((t)->pprev != 0)
+
+uint64_t sr_timer_now_ms(void);
+void sr_timer_wheel_init(struct sr_timer_wheel*, uint64_t now);
+void sr_timer_init(struct sr_timer*, void (*fn)(struct sr_timer*, void* ctx));
+void sr_timer_add(struct sr_timer_wheel*, struct sr_timer*, uint64_t expires);
+void sr_timer_del(struct sr_timer_wheel*, struct sr_timer*);
+void sr_timer_moved(struct sr_timer*);
+unsigned int sr_timer_run(struct sr_timer_wheel*, uint64_t now, void* ctx);
+
+#endif /* -- SR_TIMER_H -- */
@@ -4,22 +4,75 @@
 #include "sr_protocol.h"
 #include "pwospf_protocol.h"
 #include "sr_utils.h"
+#include "sr_cksum.h"
+#include "sr_parse.h"
 
 
+/* The one's complement sum is byte-order independent (RFC 1071), so the
+   kernels in sr_cksum.c add native-order words and the complement can be
+   stored as is. */
 uint16_t cksum (const void *_data, int len) {
-  const uint8_t *data = _data;
-  uint32_t sum;
-
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
-  while (sum > 0xffff)
-    sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
+  uint16_t sum = ~sr_cksum_sum(_data, len);
   return sum ? sum : 0xffff;
 }
 
+/* Incremental checksum update (RFC 1624, eqn. 3): HC' = ~(~HC + ~m + m').
+   sum, old and new are taken as they sit in the packet (network order);
+   the one's complement sum does not depend on byte order. The result
+   follows cksum() in never returning 0x0000, so it is bit-identical to
+   recomputing the whole checksum. */
+uint16_t cksum_adjust (uint16_t sum, uint16_t old, uint16_t new_) {
+  uint32_t acc = (uint16_t) ~sum + (uint16_t) ~old + new_;
+
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  sum = ~acc;
+  return sum ? sum : 0xffff;
+}
+
+/* Same as cksum_adjust for a 32-bit field, e.g. an IP address. */
+uint16_t cksum_adjust32 (uint16_t sum, uint32_t old, uint32_t new_) {
+  sum = cksum_adjust(sum, (uint16_t) (old >> 16), (uint16_t) (new_ >> 16));
+  return cksum_adjust(sum, (uint16_t) old, (uint16_t) new_);
+}
+
+/* Decrements the TTL and patches ip_sum for the change, without
+   recomputing the header checksum. */
+void ip_decrement_ttl (sr_ip_hdr_t *ipHdr) {
+  uint16_t old, new_;
+
+  /* TTL shares its 16-bit word with the protocol field */
+  memcpy(&old, &ipHdr->ip_ttl, sizeof(old));
+  ipHdr->ip_ttl--;
+  memcpy(&new_, &ipHdr->ip_ttl, sizeof(new_));
+  ipHdr->ip_sum = cksum_adjust(ipHdr->ip_sum, old, new_);
+}
+
+/* Hashes a packet's flow: addresses, protocol and, for unfragmented TCP
+   and UDP, the ports. len counts the bytes available from the IP header
+   on. Fragments hash on the addresses and protocol only, so they stay
+   with the rest of their datagram. Users pick different seeds so that
+   their choices are independent of each other. */
+uint32_t ip_flow_hash (const sr_ip_hdr_t *ipHdr, unsigned int len, uint32_t seed) {
+  unsigned int hl = ipHdr->ip_hl * 4;
+  uint32_t h, ports;
+
+  h = seed ^ ipHdr->ip_src ^ (ipHdr->ip_dst * 2654435761U) ^ ipHdr->ip_p;
+  if ((ntohs(ipHdr->ip_off) & (IP_MF | IP_OFFMASK)) == 0 &&
+      (ipHdr->ip_p == ip_protocol_tcp || ipHdr->ip_p == ip_protocol_udp) &&
+      len >= hl + sizeof(ports)) {
+    memcpy(&ports, (const uint8_t *) ipHdr + hl, sizeof(ports));
+    h ^= ports * 0x9e3779b1U;
+  }
+
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
+}
+
 uint32_t ip_cksum (sr_ip_hdr_t *ipHdr, int len) {
     uint16_t currChksum, calcChksum;
 
@@ -64,77 +117,14 @@ uint32_t ospfv2_cksum (ospfv2_hdr_t *ospfv2Hdr, int len) {
     return calcChksum;
 }
 
+/* Full validation of a frame, L4 checksums included, whatever its
+   destination; the data plane uses sr_parse_packet, which skips the L4
+   checks for transit traffic. */
 int is_packet_valid(uint8_t *packet /* lent */,
     unsigned int len) {
+  struct sr_pkt_meta meta;
 
-  int cumulative_sz = sizeof(sr_ethernet_hdr_t);
-  sr_ethernet_hdr_t *eHdr = (sr_ethernet_hdr_t *) packet;
-    
-  printf("*** -> Perform validation on the packet.\n");
-
-  if (eHdr->ether_type == htons(ethertype_arp)) {
-    printf("**** -> Validate ARP packet.\n");
-    cumulative_sz += sizeof(sr_arp_hdr_t);
-    if (len >= cumulative_sz) {
-      printf("***** -> Packet length is correct.\n");
-      return 1;
-    }
-  } else if (eHdr->ether_type == htons(ethertype_ip)) {
-    printf("**** -> Validate IP packet.\n");
-    sr_ip_hdr_t *ipHdr = (sr_ip_hdr_t *) (packet + cumulative_sz);
-    cumulative_sz += sizeof(sr_ip_hdr_t);
-
-    if (len >= cumulative_sz) {
-      printf("***** -> Packet length is correct.\n");
-      if (ip_cksum(ipHdr, sizeof(sr_ip_hdr_t)) == ipHdr->ip_sum) {
-        printf("***** -> IP packet checksum is correct.\n");
-        if (ipHdr->ip_p == ip_protocol_icmp) {
-          printf("***** -> IP packet is ICMP packet. Validate ICMP packet.\n");
-          int icmpOffset = cumulative_sz;
-          sr_icmp_hdr_t *icmpHdr = (sr_icmp_hdr_t *) (packet + cumulative_sz);
-          cumulative_sz += sizeof(sr_icmp_hdr_t);
-
-          if (len >= cumulative_sz) {
-            printf("****** -> Packet length is correct.\n");
-            if (icmp_cksum(icmpHdr, len - icmpOffset) == icmpHdr->icmp_sum) {
-              printf("****** -> ICMP packet checksum is correct.\n");
-              return 1;
-            }
-          }
-        } else if (ipHdr->ip_p == ip_protocol_ospfv2) {
-          printf("***** -> IP packet is OSPF packet. Validate OSPF packet.\n");
-          int ospfOffset = cumulative_sz;
-          ospfv2_hdr_t *ospfHdr = (ospfv2_hdr_t *) (packet + cumulative_sz);
-          cumulative_sz += sizeof(ospfv2_hdr_t);
-
-          if (len >= cumulative_sz) {
-            printf("****** -> Packet length is correct.\n");
-            if (ospfv2_cksum(ospfHdr, len - ospfOffset) == ospfHdr->csum) {
-              printf("****** -> OSPF packet checksum is correct.\n");
-              return 1;
-            }
-          }
-        } else {
-          /* TODO */
-          printf("***** -> IP packet is of unknown protocol. No further validation is required.\n");
-	        return 1;
-        }
-      }
-    }
-  }
-  printf("*** -> Packet validation complete. Packet is INVALID.\n");
-  return 0;
-}
-
-/* Helper function for sr_arp_request_send to generate
-   broadcast MAC address. */ 
-uint8_t *generate_ethernet_addr(uint8_t x) {
-    uint8_t *mac = malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
-    int i;
-    for (i = 0; i < ETHER_ADDR_LEN; i++) {
-        mac[i] = x;
-    }
-    return mac;
+  return sr_parse_frame(packet, len, &meta) && sr_parse_check_l4(packet, &meta);
 }
 
 uint16_t ethertype(uint8_t *buf) {
@@ -31,12 +31,15 @@
 #include "pwospf_protocol.h"
 
 uint16_t cksum(const void *_data, int len);
+uint16_t cksum_adjust(uint16_t sum, uint16_t old, uint16_t new_);
+uint16_t cksum_adjust32(uint16_t sum, uint32_t old, uint32_t new_);
+void ip_decrement_ttl(sr_ip_hdr_t *ipHdr);
+uint32_t ip_flow_hash(const sr_ip_hdr_t *ipHdr, unsigned int len, uint32_t seed);
 uint32_t ip_cksum (sr_ip_hdr_t *ipHdr, int len);
 uint32_t icmp_cksum (sr_icmp_hdr_t *icmpHdr, int len);
 uint32_t icmp3_cksum(sr_icmp_t3_hdr_t *icmp3_hdr, int len);
 uint32_t ospfv2_cksum(ospfv2_hdr_t *ospfv2_hdr, int len);
 int is_packet_valid(uint8_t *, unsigned int);
-uint8_t *generate_ethernet_addr(uint8_t);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
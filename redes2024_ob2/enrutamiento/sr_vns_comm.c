@@ -35,11 +35,17 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_rcu.h"
+#include "sr_pktbuf.h"
+#include "sr_worker.h"
+#include "sr_counters.h"
+#include "sr_egress.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
@@ -48,7 +54,7 @@ static void sr_log_packet(struct sr_instance* , uint8_t* , int );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_if* iface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
 
 /*-----------------------------------------------------------------------------
@@ -227,6 +233,13 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
         } /* -- switch -- */
     } /* -- for -- */
 
+    /* -- addresses of the whole set of interfaces just reported -- */
+    sr_local_rebuild(sr);
+
+    /* -- MTUs given with -m, now that the interfaces exist -- */
+    if(sr->if_mtus != 0)
+    { sr_set_interface_mtus(sr, sr->if_mtus); }
+
     printf("Router interfaces:\n");
     sr_print_if_list(sr);
 
@@ -335,8 +348,10 @@ int sr_read_from_server(struct sr_instance* sr /* borrowed */)
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
 {
     int command, len;
+    struct sr_pktbuf *pb = 0;
     unsigned char *buf = 0;
     c_packet_ethernet_header* sr_pkt = 0;
+    struct sr_if* iface = 0;
     int ret = 0, bytes_read = 0;
 
     /* REQUIRES */
@@ -377,11 +392,12 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         return -1;
     }
 
-    if((buf = malloc(len)) == 0)
-    {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
-        return -1;
-    }
+    /* -- read straight into a pooled buffer, leaving the packet header
+          right in front of the frame so it can be forwarded in place -- */
+    assert(SR_PKTBUF_HEADROOM >= sizeof(c_packet_header));
+    pb = sr_pktbuf_get();
+    buf = sr_pktbuf_frame(pb) - sizeof(c_packet_header);
+    assert(len <= SR_PKTBUF_SIZE - (SR_PKTBUF_HEADROOM - sizeof(c_packet_header)));
 
     /* set first field of command since we've already read it */
     *((int *)buf) = htonl(len);
@@ -401,6 +417,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 { continue; }
                 fprintf(stderr,"Error: failed reading command body %d\n",ret);
                 close(sr->sockfd);
+                sr_pktbuf_put(pb);
                 return -1;
             }
             bytes_read += ret;
@@ -415,6 +432,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     if(expected_cmd && command!=expected_cmd) {
         if(command != VNSCLOSE) { /* VNSCLOSE is always ok */
             fprintf(stderr, "Error: expected command %d but got %d\n", expected_cmd, command);
+            sr_pktbuf_put(pb);
             return -1;
         }
     }
@@ -427,24 +445,48 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         case VNSPACKET:
             sr_pkt = (c_packet_ethernet_header *)buf;
 
+            /* -- the interface name is translated once, from here on
+                  the frame carries its ifindex -- */
+            iface = sr_get_interface(sr, (char*)(buf + sizeof(c_base)));
+            if ( iface == 0 ){
+                fprintf( stderr, "** Error, packet on unknown interface\n");
+                break;
+            }
+            sr_count_rx(iface->ifindex, len - sizeof(c_packet_ethernet_header) +
+                    sizeof(struct sr_ethernet_hdr));
+            sr_log_event(IP, SR_LOG_TRACE, SR_EV_RX, iface->ifindex,
+                         len - sizeof(c_packet_ethernet_header) + sizeof(struct sr_ethernet_hdr));
+
             /* -- check if it is an ARP to another router if so drop   -- */
             if ( sr_arp_req_not_for_us(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
+                    iface) )
             { break; }
 
             /* -- log packet -- */
             sr_log_packet(sr, buf + sizeof(c_packet_header),
                     ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
 
+            /* -- with workers running, the frame's flow picks one of them
+                  and the buffer goes along with it -- */
+            if ( sr->num_workers > 0 )
+            {
+                if ( sr_worker_dispatch(sr, pb, len - sizeof(c_packet_ethernet_header) +
+                            sizeof(struct sr_ethernet_hdr), iface->ifindex) )
+                { pb = 0; }
+                break;
+            }
+
             /* -- pass to router, student's code should take over here -- */
+            sr_rcu_read_lock();
             sr_handlepacket(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+                    iface->name, &pb);
+            sr_rcu_read_unlock();
 
             break;
 
@@ -455,8 +497,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
 
-            if(buf)
-            { free(buf); }
+            sr_pktbuf_put(pb);
             return 0;
             break;
 
@@ -502,8 +543,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
+    if(pb)
+    { sr_pktbuf_put(pb); }
     return ret;
 }/* -- sr_read_from_server -- */
 
@@ -518,23 +559,16 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 static int
 sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
                                 uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
+                                struct sr_if* iface /* borrowed */ )
 {
     struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(sr);
     assert(buf);
-    assert(name);
+    assert(iface);
 
     ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
-
-    if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
-    }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
         fprintf( stderr, "** Error, source address does not match interface\n");
@@ -551,6 +585,77 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 
 } /* -- sr_ether_addrs_match_interface -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_to_egress(..)
+ * Scope: Local
+ *
+ * Copy a frame, given in pieces, to a buffer of the shared pool and
+ * queue it for interface ifindex (see sr_egress.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_send_to_egress(struct sr_instance* sr,
+                             const struct iovec* iov /* borrowed */,
+                             int iovcnt,
+                             unsigned int ifindex)
+{
+    struct sr_pktbuf* pb = sr_pktbuf_get_shared();
+    unsigned int len = 0;
+    int i;
+
+    for ( i = 0; i < iovcnt; i++ ){
+        if ( len + iov[i].iov_len > SR_PKTBUF_SIZE - SR_PKTBUF_HEADROOM ){
+            fprintf(stderr , "** Error: packet is too long to queue\n");
+            sr_pktbuf_put(pb);
+            return -1;
+        }
+        memcpy(sr_pktbuf_frame(pb) + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    sr_pktbuf_count_copy();
+
+    return sr_egress_enqueue(sr, pb, len, ifindex);
+} /* -- sr_send_to_egress -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_check(..)
+ * Scope: Local
+ *
+ * Checks and logging shared by the senders that get the frame in one
+ * piece, returns the output interface or 0 if the frame can't be sent.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_if* sr_send_check(struct sr_instance* sr,
+                                   uint8_t* buf /* borrowed */,
+                                   unsigned int len,
+                                   unsigned int ifindex)
+{
+    struct sr_if* iface = 0;
+
+    /* don't waste my time ... */
+    if ( len < sizeof(struct sr_ethernet_hdr) ){
+        fprintf(stderr , "** Error: packet is wayy to short \n");
+        return 0;
+    }
+
+    iface = sr_get_interface_by_index(sr, ifindex);
+    if ( iface == 0 ){
+        fprintf( stderr, "** Error, interface %u, does not exist\n", ifindex);
+        return 0;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr,buf,len);
+
+    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
+        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
+        return 0;
+    }
+
+    return iface;
+} /* -- sr_send_check -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_send_packet(..)
  * Scope: Global
@@ -566,6 +671,8 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          const char* iface /* borrowed */)
 {
     c_packet_header *sr_pkt;
+    struct sr_if* ifp = 0;
+    struct iovec iov;
     unsigned int total_len =  len + (sizeof(c_packet_header));
 
     /* REQUIRES */
@@ -579,35 +686,287 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
         return -1;
     }
 
+    ifp = sr_get_interface(sr, iface);
+    if ( ifp == 0 ){
+        fprintf( stderr, "** Error, interface %s, does not exist\n", iface);
+        return -1;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr,buf,len);
+
+    if ( ! sr_ether_addrs_match_interface( sr, buf, ifp) ){
+        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
+
+    /* -- with output queues the scheduler thread writes it -- */
+    if ( sr->egress ){
+        iov.iov_base = buf;
+        iov.iov_len = len;
+        return sr_send_to_egress(sr, &iov, 1, ifp->ifindex);
+    }
+
     /* Create packet */
     sr_pkt = (c_packet_header *)malloc(len +
             sizeof(c_packet_header));
     assert(sr_pkt);
+    sr_pktbuf_count_copy();
     sr_pkt->mLen  = htonl(total_len);
     sr_pkt->mType = htonl(VNSPACKET);
     strncpy(sr_pkt->mInterfaceName,iface,16);
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
-    /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
+    pthread_mutex_lock(&(sr->send_lock));
+    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
+        pthread_mutex_unlock(&(sr->send_lock));
+        fprintf(stderr, "Error writing packet\n");
+        free(sr_pkt);
+        return -1;
+    }
+    pthread_mutex_unlock(&(sr->send_lock));
+    sr_count_tx(ifp->ifindex, len);
 
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
+    free(sr_pkt);
+
+    return 0;
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_inplace(..)
+ * Scope: Global
+ *
+ * Same as sr_send_packet(..) but without copying the frame, and with the
+ * output interface given by its ifindex: the packet header is written
+ * into the sizeof(c_packet_header) bytes right before buf, which must be
+ * writable and unused. Frames handed to sr_handlepacket by
+ * sr_read_from_server always have that headroom (see sr_pktbuf.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_inplace(struct sr_instance* sr /* borrowed */,
+                           uint8_t* buf /* borrowed */ ,
+                           unsigned int len,
+                           unsigned int ifindex)
+{
+    c_packet_header *sr_pkt;
+    struct sr_if* iface = 0;
+    struct iovec iov;
+    unsigned int total_len =  len + (sizeof(c_packet_header));
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+
+    iface = sr_send_check(sr, buf, len, ifindex);
+    if ( iface == 0 ){
         return -1;
     }
 
+    /* -- the caller keeps buf, so the queued frame is a copy -- */
+    if ( sr->egress ){
+        iov.iov_base = buf;
+        iov.iov_len = len;
+        return sr_send_to_egress(sr, &iov, 1, ifindex);
+    }
+
+    sr_pkt = (c_packet_header *)(buf - sizeof(c_packet_header));
+    sr_pkt->mLen  = htonl(total_len);
+    sr_pkt->mType = htonl(VNSPACKET);
+    strncpy(sr_pkt->mInterfaceName, iface->name, sizeof(sr_pkt->mInterfaceName));
+
+    pthread_mutex_lock(&(sr->send_lock));
     if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
+        pthread_mutex_unlock(&(sr->send_lock));
         fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
         return -1;
     }
+    pthread_mutex_unlock(&(sr->send_lock));
+    sr_count_tx(ifindex, len);
 
-    free(sr_pkt);
+    return 0;
+} /* -- sr_send_packet_inplace -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_pktbuf(..)
+ * Scope: Global
+ *
+ * Same as sr_send_packet_inplace(..) for the frame at sr_pktbuf_frame(pb),
+ * but the buffer is handed over: with output queues (sr_egress.h) the
+ * frame waits in it, without a copy, until the scheduler writes it;
+ * otherwise it is sent right away. Either way pb goes back to its pool.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_pktbuf(struct sr_instance* sr /* borrowed */,
+                   struct sr_pktbuf* pb /* given */,
+                   unsigned int len,
+                   unsigned int ifindex)
+{
+    int ret;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(pb);
+
+    if ( ! sr->egress ){
+        ret = sr_send_packet_inplace(sr, sr_pktbuf_frame(pb), len, ifindex);
+        sr_pktbuf_put(pb);
+        return ret;
+    }
+
+    if ( sr_send_check(sr, sr_pktbuf_frame(pb), len, ifindex) == 0 ){
+        sr_pktbuf_put(pb);
+        return -1;
+    }
+
+    return sr_egress_enqueue(sr, pb, len, ifindex);
+} /* -- sr_send_pktbuf -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_write_frames(..)
+ * Scope: Global
+ *
+ * Write n frames for interface ifindex with a single writev(..). Each
+ * frame must have free headroom for its packet header, as in
+ * sr_send_packet_inplace(..), and must already be checked and logged.
+ * The output queue scheduler (sr_egress.c) writes with this.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_write_frames(struct sr_instance* sr /* borrowed */,
+                    uint8_t* const* frames /* borrowed */,
+                    const unsigned int* lens,
+                    unsigned int n,
+                    unsigned int ifindex)
+{
+    c_packet_header *sr_pkt;
+    struct iovec vec[SR_EGRESS_BATCH];
+    struct sr_if* iface = 0;
+    ssize_t total_len = 0;
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(frames);
+    assert(n > 0 && n <= SR_EGRESS_BATCH);
+
+    iface = sr_get_interface_by_index(sr, ifindex);
+    assert(iface);
+
+    for ( i = 0; i < n; i++ ){
+        sr_pkt = (c_packet_header *)(frames[i] - sizeof(c_packet_header));
+        sr_pkt->mLen  = htonl(lens[i] + sizeof(c_packet_header));
+        sr_pkt->mType = htonl(VNSPACKET);
+        strncpy(sr_pkt->mInterfaceName, iface->name, sizeof(sr_pkt->mInterfaceName));
+        vec[i].iov_base = sr_pkt;
+        vec[i].iov_len = lens[i] + sizeof(c_packet_header);
+        total_len += vec[i].iov_len;
+    }
+
+    pthread_mutex_lock(&(sr->send_lock));
+    if( writev(sr->sockfd, vec, n) < total_len ){
+        pthread_mutex_unlock(&(sr->send_lock));
+        fprintf(stderr, "Error writing packet\n");
+        return -1;
+    }
+    pthread_mutex_unlock(&(sr->send_lock));
+
+    for ( i = 0; i < n; i++ ){
+        sr_count_tx(ifindex, lens[i]);
+    }
 
     return 0;
-} /* -- sr_send_packet -- */
+} /* -- sr_write_frames -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packetv(..)
+ * Scope: Global
+ *
+ * Same as sr_send_packet_inplace(..) but the frame is given in pieces,
+ * gathered by writev(..) right after a packet header built on the stack.
+ * The first piece must hold the whole ethernet header. Used to send the
+ * fragments of a datagram straight from its buffer (see sr_frag.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packetv(struct sr_instance* sr /* borrowed */,
+                    const struct iovec* iov /* borrowed */,
+                    int iovcnt,
+                    unsigned int ifindex)
+{
+    c_packet_header sr_pkt;
+    struct iovec vec[SR_SEND_IOV_MAX + 1];
+    struct sr_if* iface = 0;
+    uint8_t* copy = 0;
+    unsigned int len = 0;
+    unsigned int total_len;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(iov);
+    assert(iovcnt > 0 && iovcnt <= SR_SEND_IOV_MAX);
+
+    for ( i = 0; i < iovcnt; i++ ){
+        len += iov[i].iov_len;
+    }
+    total_len = len + sizeof(c_packet_header);
+
+    /* don't waste my time ... */
+    if ( iov[0].iov_len < sizeof(struct sr_ethernet_hdr) ){
+        fprintf(stderr , "** Error: packet is wayy to short \n");
+        return -1;
+    }
+
+    iface = sr_get_interface_by_index(sr, ifindex);
+    if ( iface == 0 ){
+        fprintf( stderr, "** Error, interface %u, does not exist\n", ifindex);
+        return -1;
+    }
+
+    /* -- log packet, the dump needs it in one piece -- */
+    if ( sr->logfile ){
+        copy = (uint8_t*)malloc(len);
+        assert(copy);
+        sr_pktbuf_count_copy();
+        for ( i = 0, len = 0; i < iovcnt; i++ ){
+            memcpy(copy + len, iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+        sr_log_packet(sr,copy,len);
+        free(copy);
+    }
+
+    if ( ! sr_ether_addrs_match_interface( sr, iov[0].iov_base, iface) ){
+        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
+
+    /* -- queued fragments need a buffer of their own -- */
+    if ( sr->egress ){
+        return sr_send_to_egress(sr, iov, iovcnt, ifindex);
+    }
+
+    sr_pkt.mLen  = htonl(total_len);
+    sr_pkt.mType = htonl(VNSPACKET);
+    strncpy(sr_pkt.mInterfaceName, iface->name, sizeof(sr_pkt.mInterfaceName));
+    vec[0].iov_base = &sr_pkt;
+    vec[0].iov_len = sizeof(c_packet_header);
+    memcpy(vec + 1, iov, iovcnt * sizeof(struct iovec));
+
+    pthread_mutex_lock(&(sr->send_lock));
+    if( writev(sr->sockfd, vec, iovcnt + 1) < (ssize_t)total_len ){
+        pthread_mutex_unlock(&(sr->send_lock));
+        fprintf(stderr, "Error writing packet\n");
+        return -1;
+    }
+    pthread_mutex_unlock(&(sr->send_lock));
+    sr_count_tx(ifindex, len);
+
+    return 0;
+} /* -- sr_send_packetv -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
@@ -632,8 +991,10 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
     h.caplen = size;
     h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
 
+    pthread_mutex_lock(&(sr->send_lock));
     sr_dump(sr->logfile, &h, buf);
     fflush(sr->logfile);
+    pthread_mutex_unlock(&(sr->send_lock));
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
@@ -645,9 +1006,8 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface  /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arp_hdr*       a_hdr = 0;
 
@@ -0,0 +1,216 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.c
+ *
+ * Descripción:
+ *
+ * Hilos trabajadores y reparto de tramas por flujo, ver sr_worker.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <netinet/in.h>
+
+#include "sr_worker.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_pktbuf.h"
+#include "sr_graph.h"
+#include "sr_utils.h"
+#include "sr_counters.h"
+#include "sr_slowpath.h"
+
+/* Vueltas que un trabajador espera activamente antes de dormirse */
+#define SR_WORKER_SPIN 1024
+
+/* Trabajador que procesa la trama: hash del flujo, ver sr_worker.h */
+static unsigned int sr_worker_pick(struct sr_instance* sr, const uint8_t* frame, unsigned int len)
+{
+    const sr_ethernet_hdr_t* eHdr = (const sr_ethernet_hdr_t*)frame;
+    const sr_ip_hdr_t* ipHdr;
+
+    if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+        ntohs(eHdr->ether_type) != ethertype_ip)
+    {
+        return 0;
+    }
+
+    ipHdr = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    if (ipHdr->ip_p == ip_protocol_ospfv2)
+    {
+        return 0;
+    }
+
+    return ip_flow_hash(ipHdr, len - sizeof(sr_ethernet_hdr_t), 0) % sr->num_workers;
+}
+
+/* Duerme hasta que el lector encole algo */
+static void sr_worker_wait(struct sr_worker* w)
+{
+    pthread_mutex_lock(&(w->lock));
+    __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (w->tail == __atomic_load_n(&w->head, __ATOMIC_SEQ_CST))
+    {
+        pthread_cond_wait(&(w->cond), &(w->lock));
+    }
+    __atomic_store_n(&w->sleeping, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&(w->lock));
+}
+
+static void* sr_worker_run(void* arg)
+{
+    struct sr_worker* w = (struct sr_worker*)arg;
+    struct sr_graph_pkt pkts[SR_VEC_MAX];
+    struct sr_worker_item* item;
+    unsigned int tail, n, i, spins = 0;
+
+    sr_slowpath_attach(w->sr, w - w->sr->workers);
+
+    for (;;)
+    {
+        tail = w->tail;
+        n = __atomic_load_n(&w->head, __ATOMIC_ACQUIRE) - tail;
+        if (n == 0)
+        {
+            if (++spins >= SR_WORKER_SPIN)
+            {
+                sr_worker_wait(w);
+                spins = 0;
+            }
+            continue;
+        }
+        spins = 0;
+
+        /* Todo lo encolado, hasta un vector, se procesa de una vez */
+        if (n > SR_VEC_MAX)
+        {
+            n = SR_VEC_MAX;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            item = &w->ring[(tail + i) & (SR_WORKER_RING - 1)];
+            pkts[i].frame = sr_pktbuf_frame(item->pb);
+            pkts[i].len = item->len;
+            pkts[i].ifindex = item->ifindex;
+            pkts[i].adj = NULL;
+            pkts[i].pb = item->pb;
+        }
+
+        sr_graph_run(w->sr, pkts, n);
+
+        /* Las tramas derivadas al camino lento se llevaron su buffer */
+        for (i = 0; i < n; i++)
+        {
+            if (pkts[i].pb != NULL)
+            {
+                sr_pktbuf_put(pkts[i].pb);
+            }
+        }
+
+        /* Los lugares se liberan recién ahora: en vuelo nunca hay más
+           buffers que los que caben en la cola */
+        __atomic_store_n(&w->tail, tail + n, __ATOMIC_RELEASE);
+        w->packets += n;
+        w->vectors++;
+    }
+
+    return NULL;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_start
+ *
+ * Crea n hilos trabajadores y el del camino lento; a partir de acá
+ * sr_read_from_server les pasa las tramas en vez de procesarlas
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_start(struct sr_instance* sr, unsigned int n)
+{
+    struct sr_worker* w;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(n > 0 && n <= SR_WORKER_MAX);
+
+    sr->workers = (struct sr_worker*)calloc(n, sizeof(struct sr_worker));
+    assert(sr->workers);
+
+    /* Las excepciones de los trabajadores van al camino lento */
+    sr_slowpath_start(sr, n);
+
+    for (i = 0; i < n; i++)
+    {
+        w = &sr->workers[i];
+        w->sr = sr;
+        pthread_mutex_init(&(w->lock), NULL);
+        pthread_cond_init(&(w->cond), NULL);
+        if (pthread_create(&(w->thread), &(sr->attr), sr_worker_run, w) != 0)
+        {
+            perror("pthread_create");
+            assert(0);
+        }
+    }
+
+    __atomic_store_n(&sr->num_workers, n, __ATOMIC_RELEASE);
+} /* -- sr_workers_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_dispatch
+ *
+ * Encola la trama de pb, llegada por la interfaz ifindex, en el
+ * trabajador de su flujo. Devuelve 1 si el trabajador se quedó con el
+ * buffer, 0 si la cola estaba llena y el buffer sigue siendo de quien
+ * llama. Sólo la llama el hilo lector.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_worker_dispatch(struct sr_instance* sr, struct sr_pktbuf* pb, unsigned int len,
+                       unsigned int ifindex)
+{
+    struct sr_worker* w = &sr->workers[sr_worker_pick(sr, sr_pktbuf_frame(pb), len)];
+    unsigned int head = w->head;
+
+    if (head - __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE) >= SR_WORKER_RING)
+    {
+        w->drops++;
+        sr_count_drop(SR_DROP_QUEUE_FULL);
+        return 0;
+    }
+
+    w->ring[head & (SR_WORKER_RING - 1)].pb = pb;
+    w->ring[head & (SR_WORKER_RING - 1)].len = len;
+    w->ring[head & (SR_WORKER_RING - 1)].ifindex = ifindex;
+    __atomic_store_n(&w->head, head + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&(w->lock));
+        pthread_cond_signal(&(w->cond));
+        pthread_mutex_unlock(&(w->lock));
+    }
+    return 1;
+} /* -- sr_worker_dispatch -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_print_stats
+ *
+ * Imprime paquetes procesados y descartados por cada trabajador
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_print_stats(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    for (i = 0; i < sr->num_workers; i++)
+    {
+        printf("Trabajador %u: %lu paquetes en %lu vectores, %lu descartados\n", i,
+               sr->workers[i].packets, sr->workers[i].vectors, sr->workers[i].drops);
+    }
+} /* -- sr_workers_print_stats -- */
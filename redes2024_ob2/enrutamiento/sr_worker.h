@@ -0,0 +1,80 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.h
+ *
+ * Descripción:
+ *
+ * Reenvío en varios hilos. El hilo que lee del servidor VNS deja de
+ * procesar las tramas y las reparte entre N hilos trabajadores según un
+ * hash del flujo (IP origen y destino, protocolo y puertos TCP/UDP), así
+ * los paquetes de un mismo flujo los procesa siempre el mismo trabajador
+ * y no se reordenan. Los fragmentos se reparten sólo por direcciones y
+ * protocolo. ARP y OSPF van siempre al trabajador 0. Los trabajadores
+ * sólo reenvían; las excepciones y el plano de control los procesa el
+ * hilo del camino lento (sr_slowpath.h), de modo que el plano de control
+ * se sigue procesando en un único hilo como antes.
+ *
+ * Cada trabajador tiene su cola sin locks de un productor y un consumidor
+ * (el hilo lector) y envía sus tramas por su cuenta; sólo la escritura en
+ * el socket se serializa (sr->send_lock). La trama viaja en el buffer del
+ * pool en que se leyó (sr_pktbuf.h) y el trabajador lo devuelve al
+ * terminar. Con la cola llena la trama se descarta.
+ *
+ * El trabajador saca de su cola todo lo que haya, hasta SR_VEC_MAX
+ * tramas, y lo procesa como un vector (sr_graph.h).
+ *
+ * El estado compartido que se lee al reenviar es seguro entre hilos: la
+ * FIB se publica con RCU (sr_rcu.h), las adyacencias se leen con
+ * contadores de secuencia, la caché de destinos es por hilo y la caché
+ * ARP tiene su lock. La lista de interfaces no cambia después de
+ * conectarse.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WORKER_H
+#define SR_WORKER_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_instance;
+struct sr_pktbuf;
+
+#define SR_WORKER_MAX   8
+#define SR_WORKER_RING  256     /* -- potencia de 2, al menos SR_VEC_MAX -- */
+
+struct sr_worker_item
+{
+    struct sr_pktbuf* pb;
+    unsigned int len;           /* -- largo de la trama -- */
+    unsigned int ifindex;       /* -- interfaz de llegada -- */
+};
+
+struct sr_worker
+{
+    struct sr_instance* sr;
+    pthread_t thread;
+    struct sr_worker_item ring[SR_WORKER_RING];
+    unsigned int head;          /* -- la escribe el lector -- */
+    char pad_head[64 - sizeof(unsigned int)];
+    unsigned int tail;          /* -- la escribe el trabajador -- */
+    char pad_tail[64 - sizeof(unsigned int)];
+    int sleeping;               /* -- esperando en cond con la cola vacía -- */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned long packets;
+    unsigned long vectors;
+    unsigned long drops;        /* -- descartados con la cola llena -- */
+};
+
+void sr_workers_start(struct sr_instance*, unsigned int n);
+int sr_worker_dispatch(struct sr_instance*, struct sr_pktbuf* pb, unsigned int len, unsigned int ifindex);
+void sr_workers_print_stats(struct sr_instance*);
+
+#endif /* -- SR_WORKER_H -- */
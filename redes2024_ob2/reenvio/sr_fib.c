@@ -0,0 +1,297 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Descripción:
+ *
+ * Trie de camino comprimido para la búsqueda del prefijo más largo.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+/* Profundidad máxima del trie: un nodo por largo de prefijo (0..32) */
+#define SR_FIB_MAX_DEPTH 33
+
+/* Máscara en orden de host para un largo de prefijo */
+static uint32_t sr_fib_mask(uint8_t plen)
+{
+    return (plen == 0) ? 0 : (0xffffffffU << (32 - plen));
+}
+
+/* Bit 'pos' de la clave, contando desde el más significativo */
+static int sr_fib_bit(uint32_t key, uint8_t pos)
+{
+    return (key >> (31 - pos)) & 1;
+}
+
+/* Cantidad de bits iniciales en común entre dos claves, acotada por max */
+static uint8_t sr_fib_common_len(uint32_t a, uint32_t b, uint8_t max)
+{
+    uint32_t diff = a ^ b;
+    uint8_t common = (diff == 0) ? 32 : (uint8_t)__builtin_clz(diff);
+    return (common < max) ? common : max;
+}
+
+static struct sr_fib_node* sr_fib_new_node(struct sr_fib* fib, uint32_t prefix,
+                                           uint8_t plen, struct sr_rt* route)
+{
+    struct sr_fib_node* node = (struct sr_fib_node*)calloc(1, sizeof(struct sr_fib_node));
+    assert(node);
+    node->prefix = prefix & sr_fib_mask(plen);
+    node->plen = plen;
+    node->route = route;
+    node->refs = (route != NULL) ? 1 : 0;
+    fib->num_nodes++;
+    if (route != NULL)
+    {
+        fib->num_routes++;
+    }
+    return node;
+}
+
+static void sr_fib_free_subtree(struct sr_fib_node* node)
+{
+    if (node == NULL)
+    {
+        return;
+    }
+    sr_fib_free_subtree(node->child[0]);
+    sr_fib_free_subtree(node->child[1]);
+    free(node);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_mask_len
+ *
+ * Largo de prefijo de una máscara (en orden de red)
+ *
+ *---------------------------------------------------------------------*/
+
+uint8_t sr_fib_mask_len(uint32_t mask_nbo)
+{
+    uint32_t inverted = ~ntohl(mask_nbo);
+    return (inverted == 0) ? 32 : (uint8_t)__builtin_clz(inverted);
+} /* -- sr_fib_mask_len -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_init
+ *
+ * Inicializa un trie vacío
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_init(struct sr_fib* fib)
+{
+    assert(fib);
+    fib->root = NULL;
+    fib->num_nodes = 0;
+    fib->num_routes = 0;
+} /* -- sr_fib_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_destroy
+ *
+ * Libera todos los nodos del trie. Las entradas sr_rt no se liberan,
+ * pertenecen a la tabla de enrutamiento.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_destroy(struct sr_fib* fib)
+{
+    assert(fib);
+    sr_fib_free_subtree(fib->root);
+    sr_fib_init(fib);
+} /* -- sr_fib_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert
+ *
+ * Agrega una entrada de la tabla al trie. Si ya hay una ruta con el mismo
+ * prefijo se conserva la primera, igual que la búsqueda lineal anterior.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_insert(struct sr_fib* fib, struct sr_rt* route)
+{
+    struct sr_fib_node** link;
+    struct sr_fib_node* node;
+    struct sr_fib_node* split;
+    uint8_t plen, common;
+    uint32_t key;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(route);
+
+    plen = sr_fib_mask_len(route->mask.s_addr);
+    key = ntohl(route->dest.s_addr) & sr_fib_mask(plen);
+
+    link = &fib->root;
+    while ((node = *link) != NULL)
+    {
+        common = sr_fib_common_len(node->prefix, key, (node->plen < plen) ? node->plen : plen);
+
+        if (common < node->plen)
+        {
+            if (common == plen)
+            {
+                /* El nuevo prefijo es ancestro del nodo actual */
+                split = sr_fib_new_node(fib, key, plen, route);
+                split->child[sr_fib_bit(node->prefix, plen)] = node;
+            }
+            else
+            {
+                /* Los prefijos divergen en el bit 'common': nodo de bifurcación */
+                split = sr_fib_new_node(fib, key, common, NULL);
+                split->child[sr_fib_bit(key, common)] = sr_fib_new_node(fib, key, plen, route);
+                split->child[sr_fib_bit(node->prefix, common)] = node;
+            }
+            *link = split;
+            return;
+        }
+
+        if (node->plen == plen)
+        {
+            /* Mismo prefijo: se instala sólo si el nodo era interno */
+            if (node->route == NULL)
+            {
+                node->route = route;
+                fib->num_routes++;
+            }
+            node->refs++;
+            return;
+        }
+
+        link = &node->child[sr_fib_bit(key, node->plen)];
+    }
+
+    *link = sr_fib_new_node(fib, key, plen, route);
+} /* -- sr_fib_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_remove
+ *
+ * Quita una entrada de la tabla del trie. Si otra entrada de la tabla
+ * tiene el mismo prefijo, pasa a ser la ruta instalada. Los nodos que
+ * quedan sin ruta y con menos de dos hijos se eliminan.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_remove(struct sr_fib* fib, struct sr_rt* route, struct sr_rt* routing_table)
+{
+    struct sr_fib_node** path[SR_FIB_MAX_DEPTH];
+    struct sr_fib_node** link;
+    struct sr_fib_node* node;
+    struct sr_rt* walker;
+    int depth = 0;
+    uint8_t plen;
+    uint32_t key;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(route);
+
+    plen = sr_fib_mask_len(route->mask.s_addr);
+    key = ntohl(route->dest.s_addr) & sr_fib_mask(plen);
+
+    link = &fib->root;
+    while ((node = *link) != NULL)
+    {
+        if (node->plen > plen || ((node->prefix ^ key) & sr_fib_mask(node->plen)) != 0)
+        {
+            return; /* -- el prefijo no está en el trie -- */
+        }
+        path[depth++] = link;
+        if (node->plen == plen)
+        {
+            break;
+        }
+        link = &node->child[sr_fib_bit(key, node->plen)];
+    }
+
+    if (node == NULL || node->refs == 0)
+    {
+        return;
+    }
+
+    node->refs--;
+    if (node->route != route)
+    {
+        return; /* -- era una entrada duplicada que no estaba instalada -- */
+    }
+
+    if (node->refs > 0)
+    {
+        /* Se instala la siguiente entrada de la tabla con el mismo prefijo */
+        for (walker = routing_table; walker != NULL; walker = walker->next)
+        {
+            if (walker != route && walker->mask.s_addr == route->mask.s_addr &&
+                (walker->dest.s_addr & walker->mask.s_addr) == (route->dest.s_addr & route->mask.s_addr))
+            {
+                node->route = walker;
+                return;
+            }
+        }
+        node->refs = 0;
+    }
+
+    node->route = NULL;
+    fib->num_routes--;
+
+    /* Se podan los nodos internos que ya no bifurcan, de abajo hacia arriba */
+    while (depth > 0)
+    {
+        link = path[--depth];
+        node = *link;
+        if (node->route != NULL || (node->child[0] != NULL && node->child[1] != NULL))
+        {
+            break;
+        }
+        *link = (node->child[0] != NULL) ? node->child[0] : node->child[1];
+        free(node);
+        fib->num_nodes--;
+    }
+} /* -- sr_fib_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup
+ *
+ * Devuelve la entrada con el prefijo más largo que contiene a ip_nbo,
+ * o NULL si ninguna coincide.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(struct sr_fib* fib, uint32_t ip_nbo)
+{
+    struct sr_fib_node* node;
+    struct sr_rt* best = NULL;
+    uint32_t key = ntohl(ip_nbo);
+
+    node = fib->root;
+    while (node != NULL)
+    {
+        if (((node->prefix ^ key) & sr_fib_mask(node->plen)) != 0)
+        {
+            break;
+        }
+        if (node->route != NULL)
+        {
+            best = node->route;
+        }
+        if (node->plen == 32)
+        {
+            break;
+        }
+        node = node->child[sr_fib_bit(key, node->plen)];
+    }
+
+    return best;
+} /* -- sr_fib_lookup -- */
@@ -0,0 +1,60 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Descripción:
+ *
+ * Tabla de reenvío (FIB) indexada con un trie binario de camino comprimido
+ * (Patricia). La tabla de enrutamiento (sr->routing_table) sigue siendo la
+ * lista de struct sr_rt; el trie apunta a esas entradas y se mantiene al día
+ * desde sr_add_rt_entry y sr_load_rt.
+ *
+ * Cada nodo guarda un prefijo y su largo; los largos crecen estrictamente al
+ * descender, por lo que una búsqueda visita a lo sumo un nodo por largo de
+ * prefijo, sin importar la cantidad de rutas de la tabla.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif
+
+struct sr_rt;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_node
+ *
+ * Nodo del trie. Los nodos sin ruta son nodos internos de bifurcación.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_node
+{
+    uint32_t prefix;              /* -- prefijo en orden de host -- */
+    uint8_t  plen;                /* -- largo del prefijo (0..32) -- */
+    unsigned int refs;            /* -- entradas de la tabla con este prefijo -- */
+    struct sr_rt* route;          /* -- ruta instalada, NULL si es interno -- */
+    struct sr_fib_node* child[2];
+};
+
+struct sr_fib
+{
+    struct sr_fib_node* root;
+    unsigned int num_nodes;
+    unsigned int num_routes;
+};
+
+void sr_fib_init(struct sr_fib*);
+void sr_fib_destroy(struct sr_fib*);
+void sr_fib_insert(struct sr_fib*, struct sr_rt*);
+void sr_fib_remove(struct sr_fib*, struct sr_rt*, struct sr_rt* routing_table);
+struct sr_rt* sr_fib_lookup(struct sr_fib*, uint32_t ip_nbo);
+uint8_t sr_fib_mask_len(uint32_t mask_nbo);
+
+#endif /* -- SR_FIB_H -- */
@@ -248,6 +248,7 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->topo_id = 0;
     sr->if_list = 0;
     sr->routing_table = 0;
+    sr_fib_init(&(sr->fib));
     sr->logfile = 0;
 } /* -- sr_init_instance -- */
 
@@ -55,29 +55,9 @@ struct sr_rt *sr_longest_prefix_match(struct sr_instance *sr, uint32_t dest_ip)
     printf("SR O SR->RT ES NULL \n");
     return NULL;
   }
-  struct sr_rt *longestMatch = NULL;
-  uint32_t bestMask = 0; /* Inicializa la mejor máscara a 0 para buscar la coincidencia más larga */
-  struct sr_rt *tabla = sr->routing_table;
 
-  while (tabla != NULL)
-  {
-    /* Aplicar la máscara de red al destino IP y comparar con el prefijo de la entrada */
-    uint32_t maskedDest = tabla->mask.s_addr & dest_ip;
-    if (maskedDest == (tabla->dest.s_addr & tabla->mask.s_addr))
-    {
-      /* Si hay coincidencia, verifica si es la coincidencia más larga */
-      if (ntohl(tabla->mask.s_addr) > ntohl(bestMask))
-      {
-        longestMatch = tabla;
-        bestMask = tabla->mask.s_addr;
-      }
-    }
-
-    /* Ir a la siguiente entrada en la tabla de enrutamiento */
-    tabla = tabla->next;
-  }
-
-  return longestMatch;
+  /* El trie de sr->fib indexa las mismas entradas que sr->routing_table */
+  return sr_fib_lookup(&(sr->fib), dest_ip);
 }
 
 /* Envía un paquete ICMP de error */
@@ -21,6 +21,7 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_fib.h"
 
 /*---------------------------------------------------------------------
  * Method:
@@ -76,6 +77,7 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         }
         if( clear_routing_table == 0 ){
             printf("Loading routing table from server, clear local routing table.\n");
+            sr_fib_destroy(&(sr->fib));
             sr->routing_table = 0;
             clear_routing_table = 1;
         }
@@ -109,6 +111,7 @@ struct in_addr gw, struct in_addr mask,char* if_name)
         sr->routing_table->gw   = gw;
         sr->routing_table->mask = mask;
         strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+        sr_fib_insert(&(sr->fib), sr->routing_table);
 
         return;
     }
@@ -128,6 +131,7 @@ struct in_addr gw, struct in_addr mask,char* if_name)
     rt_walker->gw   = gw;
     rt_walker->mask = mask;
     strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+    sr_fib_insert(&(sr->fib), rt_walker);
 
 } /* -- sr_add_entry -- */
 